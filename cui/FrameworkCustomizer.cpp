@@ -288,6 +288,12 @@ void FrameworkCustomizer::customizeL() {
   LoopDetector *lpd = &lpdSS;                      // 部分地図を用いたループ検出  
   lpdSS.setPoseEstimator(&poest2);
 
+//  dass->setThreadNum(4);                         // データ対応づけを4スレッドで並列に行う
+//  dass->setReuseThre(0.01);                      // ICPの繰り返しで、点の移動が1cm以内なら前回の対応を使い回す
+//  lpdSS.setThreadNum(4);                         // ループ検出で、再訪点の候補を4スレッドで並列に調べる
+//  lpdSS.setCandidateNum(3);                     // 近い前回訪問点を3つまで、部分地図を変えて調べる
+//  lpdSS.setCorrelativeMatcher(&cmat);            // 再訪点を分枝限定法で探す
+
   popt1->setCostFunction(cfunc);
   poest.setDataAssociator(dass);
   poest.setPoseOptimizer(popt1);
@@ -393,3 +399,137 @@ void FrameworkCustomizer::customizeN() {
   sback->setHasOutliers(true);
   sback->setBeRobust(true);
 }
+
+// レーベンバーグ・マーカート法
+void FrameworkCustomizer::customizeO() {
+  pcmap = &pcmapLP;                                // 部分地図ごとに管理する点群地図
+  RefScanMaker *rsm = &rsmLM;                      // 局所地図を参照スキャンとする
+  DataAssociator *dass = &dassGT;                  // 格子テーブルによるデータ対応づけ
+  CostFunction *cfunc = &cfuncPD;                  // 垂直距離をコスト関数とする
+  PoseOptimizer *popt = &poptLM;                   // レーベンバーグ・マーカート法による最適化
+  LoopDetector *lpd = &lpdSS;                      // 部分地図を用いたループ検出
+
+  poptLM.setBeRobust(true);                        // ロバストコスト関数
+
+  popt->setCostFunction(cfunc);
+  poest.setDataAssociator(dass);
+  poest.setPoseOptimizer(popt);
+  pfu.setDataAssociator(dass);
+  smat.setPointCloudMap(pcmap);
+  smat.setRefScanMaker(rsm);
+  smat.setScanPointResampler(&spres);
+  smat.setScanPointAnalyser(&spana);
+  sfront->setLoopDetector(lpd);
+  sfront->setPointCloudMap(pcmap);
+  sfront->setDgCheck(true);                        // センサ融合する
+}
+
+// 粗密探索によるICP。customizeLの逐次SLAMを、間引いた点群から順に行う
+void FrameworkCustomizer::customizeP() {
+  pcmap = &pcmapLP;                                // 部分地図ごとに管理する点群地図
+  poptMAP.setPointCloudMap(pcmap);
+
+  RefScanMaker *rsm = &rsmLM;                      // 局所地図を参照スキャンとする
+  DataAssociator *dass = &dassGT;                  // 格子テーブルによるデータ対応づけ
+  CostFunction *cfunc = &cfuncPD;                  // 垂直距離をコスト関数とする
+  PoseOptimizer *popt1 = &poptMAP;                 // 逐次SLAM用。MAP推定あり
+  PoseOptimizer *popt2 = &poptGN;                  // ループ閉じ込み用。MAP推定なし
+  LoopDetector *lpd = &lpdSS;                      // 部分地図を用いたループ検出  
+  lpdSS.setPoseEstimator(&poest2);
+
+  poest.setLevelNum(3);                            // 4点おき、2点おき、全点の3階層。粗い階層ほど距離閾値を2倍ずつ広げる
+//  poest.setLevelNum(3, 1.0);                       // 距離閾値は全階層で同じにする
+
+  popt1->setCostFunction(cfunc);
+  poest.setDataAssociator(dass);
+  poest.setPoseOptimizer(popt1);
+
+  popt2->setCostFunction(cfunc);
+  poest2.setDataAssociator(dass);
+  poest2.setPoseOptimizer(popt2);
+  pfu.setDataAssociator(dass);
+  
+  smat2.setPoseEstimator(&poest);
+  smat2.setPoseFuser(&pfu);
+  smat2.setPointCloudMap(pcmap);
+  smat2.setRefScanMaker(rsm);
+  smat2.setScanPointResampler(&spres);
+  smat2.setScanPointAnalyser(&spana);
+
+  sfront->setLoopDetector(lpd);
+  sfront->setPointCloudMap(pcmap);
+  sfront->setScanMatcher(&smat2);
+}
+
+// 直前スキャンとのスキャンマッチングで、参照スキャンの計測方向を使ったデータ対応づけを行う
+void FrameworkCustomizer::customizeQ() {
+  pcmap = &pcmapBS;                                // 全スキャン点を保存する点群地図
+  RefScanMaker *rsm = &rsmBS;                      // 直前スキャンを参照スキャンとする
+  DataAssociator *dass = &dassPJ;                  // 計測方向によるデータ対応づけ
+  CostFunction *cfunc = &cfuncPD;                  // 垂直距離をコスト関数とする
+  PoseOptimizer *popt = &poptGN;                   // ガウスニュートン法による最適化
+  LoopDetector *lpd = &lpdDM;                      // ダミーのループ検出
+
+  popt->setCostFunction(cfunc);
+  poest.setDataAssociator(dass);
+  poest.setPoseOptimizer(popt);
+  pfu.setDataAssociator(dass);
+  smat.setPointCloudMap(pcmap);
+  smat.setRefScanMaker(rsm);
+  smat.setScanPointResampler(&spres);
+  smat.setScanPointAnalyser(&spana);
+  sfront->setLoopDetector(lpd);
+  sfront->setPointCloudMap(pcmap);
+  sfront->setDgCheck(false);                       // センサ融合しない
+}
+
+// 距離場によるスキャンマッチング。データ対応づけをせずに、局所地図の距離場の上で直接最適化する
+void FrameworkCustomizer::customizeR() {
+  pcmap = &pcmapLP;                                // 部分地図ごとに管理する点群地図
+  DataAssociator *dass = &dassGT;                  // ループ閉じ込み用。格子テーブルによるデータ対応づけ
+  CostFunction *cfunc = &cfuncPD;                  // ループ閉じ込み用。垂直距離をコスト関数とする
+  PoseOptimizer *popt = &poptGN;                   // 距離場の上でガウスニュートン法による最適化
+  LoopDetector *lpd = &lpdSS;                      // 部分地図を用いたループ検出
+
+  poptGN.setBeRobust(true);                        // ロバストコスト関数
+
+  popt->setCostFunction(cfunc);
+  poest.setDataAssociator(dass);
+  poest.setPoseOptimizer(popt);
+  pfu.setDataAssociator(dass);
+
+  smatDF.setPoseOptimizer(popt);
+  smatDF.setPoseFuser(&pfu);
+  smatDF.setPointCloudMap(pcmap);
+  smatDF.setScanPointResampler(&spres);
+  smatDF.setScanPointAnalyser(&spana);
+
+  sfront->setLoopDetector(lpd);
+  sfront->setPointCloudMap(pcmap);
+  sfront->setScanMatcher(&smatDF);
+}
+
+// 分枝限定法による相関マッチング。customizeJに、再訪点の探索と、ICP失敗時のやり直しを加える
+void FrameworkCustomizer::customizeS() {
+  pcmap = &pcmapLP;                                // 部分地図ごとに管理する点群地図
+  RefScanMaker *rsm = &rsmLM;                      // 局所地図を参照スキャンとする
+  DataAssociator *dass = &dassGT;                  // 格子テーブルによるデータ対応づけ
+  CostFunction *cfunc = &cfuncPD;                  // 垂直距離をコスト関数とする
+  PoseOptimizer *popt = &poptGN;                   // ガウスニュートン法による最適化
+  LoopDetector *lpd = &lpdSS;                      // 部分地図を用いたループ検出
+
+  lpdSS.setCorrelativeMatcher(&cmat);              // 再訪点を分枝限定法で探す
+  smat.setCorrelativeMatcher(&cmat2);              // ICPに失敗したら相関マッチングでやり直す
+
+  popt->setCostFunction(cfunc);
+  poest.setDataAssociator(dass);
+  poest.setPoseOptimizer(popt);
+  pfu.setDataAssociator(dass);
+  smat.setPointCloudMap(pcmap);
+  smat.setRefScanMaker(rsm);
+  smat.setScanPointResampler(&spres);
+  smat.setScanPointAnalyser(&spana);
+  sfront->setLoopDetector(lpd);
+  sfront->setPointCloudMap(pcmap);
+  sfront->setDgCheck(true);                        // センサ融合する
+}
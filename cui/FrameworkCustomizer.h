@@ -24,6 +24,7 @@
 #include "DataAssociatorGT.h" 
 #include "DataAssociatorLS.h" 
 #include "DataAssociatorNN.h"
+#include "DataAssociatorProjective.h"
 #include "CostFunction.h" 
 #include "CostFunctionED.h" 
 #include "CostFunctionPD.h" 
@@ -32,6 +33,7 @@
 #include "PoseOptimizerSL.h" 
 #include "PoseOptimizerGN.h" 
 #include "PoseOptimizerMAP.h" 
+#include "PoseOptimizerLM.h" 
 #include "PointCloudMap.h" 
 #include "PointCloudMapBS.h" 
 #include "PointCloudMapGT.h" 
@@ -46,6 +48,8 @@
 #include "SlamFrontEnd.h" 
 #include "SlamBackEnd.h" 
 #include "ScanMatcherRB.h"
+#include "ScanMatcherDF.h"
+#include "CorrelativeMatcher.h"
 
 class FrameworkCustomizer
 {
@@ -55,12 +59,14 @@ class FrameworkCustomizer
   DataAssociatorGT dassGT;
   DataAssociatorLS dassLS;
   DataAssociatorNN dassNN;
+  DataAssociatorProjective dassPJ;
   CostFunctionED cfuncED;
   CostFunctionPD cfuncPD;
   PoseOptimizerSD poptSD;
   PoseOptimizerSL poptSL;
   PoseOptimizerGN poptGN;
   PoseOptimizerMAP poptMAP;
+  PoseOptimizerLM poptLM;
   PointCloudMapBS pcmapBS;
   PointCloudMapGT pcmapGT;
   PointCloudMapLP pcmapLP;
@@ -69,12 +75,15 @@ class FrameworkCustomizer
   LoopDetectorSS lpdSS;
   ScanPointResampler spres;
   ScanPointAnalyser spana;
+  CorrelativeMatcher cmat;         // ループ検出用
+  CorrelativeMatcher cmat2;        // ICP失敗時のやり直し用
 
   PoseEstimatorICP poest;
   PoseEstimatorICP poest2;
   PoseFuser pfu;
   ScanMatcher2D smat;
   ScanMatcherRB smat2;
+  ScanMatcherDF smatDF;
 
   SlamFrontEnd *sfront;
 
@@ -110,6 +119,11 @@ public:
   void customizeL();
   void customizeM();
   void customizeN();
+  void customizeO();
+  void customizeP();
+  void customizeQ();
+  void customizeR();
+  void customizeS();
 };
 
 #endif
@@ -27,9 +27,15 @@ void SlamLauncher::run() {
   if (startN > 0)
     skipData(startN);                      // startNまでデータを読み飛ばす
 
+  if (prefetchDepth > 0) {                 // 読み込みスレッドを起動して先読みさせる
+    sprefetch.setSensorDataReader(&sreader);
+    sprefetch.setDepth(prefetchDepth);
+    sprefetch.start(cnt);
+  }
+
   double totalTime=0, totalTimeDraw=0, totalTimeRead=0;
   Scan2D scan;
-  bool eof = sreader.loadScan(cnt, scan);  // ファイルからスキャンを1個読み込む
+  bool eof = loadScan(cnt, scan);          // ファイルからスキャンを1個読み込む
   chrono_time t0 = clock();
   while(!eof) {
     if (odometryOnly) {                      // オドメトリによる地図構築（SLAMより優先）
@@ -51,7 +57,7 @@ void SlamLauncher::run() {
     chrono_time t2 = clock();
 
     ++cnt;                                 // 論理時刻更新
-    eof = sreader.loadScan(cnt, scan);     // 次のスキャンを読み込む
+    eof = loadScan(cnt, scan);             // 次のスキャンを読み込む
 
     chrono_time t3 = clock();
     totalTime = duration(t0, t3);          // 全体処理時間
@@ -60,8 +66,17 @@ void SlamLauncher::run() {
 
     printf("---- SlamLauncher: cnt=%zu ends ----\n", cnt);
   }
+  if (sprefetch.isRunning()) {
+    sprefetch.stop();                      // ファイルを閉じる前に読み込みスレッドを止める
+    sprefetch.printStats();
+  }
   sreader.closeScanFile();
 
+  if (!odometryOnly && sfront.getAsyncBackEnd()) {
+    sfront.finish();                       // 別スレッドのループ閉じ込みが残っていれば、終わるのを待って反映する
+    mdrawer.drawMapGp(*pcmap);
+  }
+
   printf("Elapsed time: mapping=%g, drawing=%g, reading=%g\n", (totalTime-totalTimeDraw-totalTimeRead), totalTimeDraw, totalTimeRead);
   printf("SlamLauncher finished.\n");
 
@@ -75,13 +90,18 @@ void SlamLauncher::run() {
   }
 }
 
-// 開始からnum個のスキャンまで読み飛ばす
+// 開始からnum個のスキャンまで読み飛ばす。索引を使ってnum番目のスキャンに直接移動する
 void SlamLauncher::skipData(int num) {
-  Scan2D scan;
-  bool eof = sreader.loadScan(0, scan);
-  for (int i=0; !eof && i<num; i++) {       // num個空読みする
-    eof = sreader.loadScan(0, scan);
-  }
+  if (!sreader.seekScan(num))
+    printf("Warning: startN=%d exceeds the number of scans (%zu)\n", num, sreader.getScanNum());
+}
+
+// スキャンを1個読み込む。先読みしている場合はリングバッファから取り出す
+bool SlamLauncher::loadScan(size_t cnt, Scan2D &scan) {
+  if (sprefetch.isRunning())
+    return(sprefetch.loadScan(cnt, scan));
+  else
+    return(sreader.loadScan(cnt, scan));
 }
 
 ///////// オドメトリのよる地図構築 //////////
@@ -169,6 +189,11 @@ void SlamLauncher::customizeFramework() {
 //  fcustom.customizeL();                         // 第11章 MAP推定
 //  fcustom.customizeM();                         // 第11章 kd木を用いたデータ対応づけ
   fcustom.customizeN();                         // 第11章 ロバストループ閉じ込みをする
+//  fcustom.customizeO();                         // レーベンバーグ・マーカート法
+//  fcustom.customizeP();                         // 粗密探索によるICP
+//  fcustom.customizeQ();                         // 計測方向によるデータ対応づけ
+//  fcustom.customizeR();                         // 距離場によるスキャンマッチング
+//  fcustom.customizeS();                         // 分枝限定法による相関マッチング
 
   pcmap = fcustom.getPointCloudMap();           // customizeの後にやること
 }
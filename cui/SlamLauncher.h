@@ -23,6 +23,7 @@
 #endif
 
 #include "SensorDataReader.h"
+#include "ScanPrefetcher.h"
 #include "PointCloudMap.h"
 #include "SlamFrontEnd.h"
 #include "SlamBackEnd.h"
@@ -42,13 +43,15 @@ private:
   Pose2D lidarOffset;              // レーザスキャナとロボットの相対位置
 
   SensorDataReader sreader;        // ファイルからのセンサデータ読み込み
+  ScanPrefetcher sprefetch;        // 別スレッドでのスキャン先読み
+  int prefetchDepth;               // 先読みするスキャン数。0なら先読みしない
   PointCloudMap *pcmap;            // 点群地図
   SlamFrontEnd sfront;             // SLAMフロントエンド
   MapDrawer mdrawer;               // gnuplotによる描画
   FrameworkCustomizer fcustom;     // フレームワークの改造
 
 public:
-  SlamLauncher() : startN(0), drawSkip(10), odometryOnly(false), pcmap(nullptr) {
+  SlamLauncher() : startN(0), drawSkip(10), odometryOnly(false), prefetchDepth(16), pcmap(nullptr) {
   }
 
   ~SlamLauncher() {
@@ -64,6 +67,15 @@ public:
     odometryOnly = p;
   }
 
+  void setPrefetchDepth(int n) {
+    prefetchDepth = n;
+  }
+
+  // ループ閉じ込みを別スレッドで行うか
+  void setAsyncBackEnd(bool t) {
+    sfront.setAsyncBackEnd(t);
+  }
+
 ///////////
 
   void run();
@@ -71,6 +83,7 @@ public:
   void mapByOdometry(Scan2D *scan);
   bool setFilename(char *filename);
   void skipData(int num);
+  bool loadScan(size_t cnt, Scan2D &scan);
   void customizeFramework();
 };
 
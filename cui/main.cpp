@@ -12,11 +12,15 @@
  * @author Masahiro Tomono
  ****************************************************************************/
 
+#include <string>
 #include "SlamLauncher.h"
+#include "SensorDataBinary.h"
 
 int main(int argc, char *argv[]) {
   bool scanCheck=false;              // スキャン表示のみか
   bool odometryOnly=false;           // オドメトリによる地図構築か
+  bool convertOnly=false;            // バイナリ形式への変換のみか
+  bool asyncBackEnd=false;           // ループ閉じ込みを別スレッドで行うか
   char *filename;                    // データファイル名
   int startN=0;                      // 開始スキャン番号
 
@@ -37,6 +41,10 @@ int main(int argc, char *argv[]) {
         scanCheck = true;
       else if (option == 'o')        // オドメトリによる地図構築
         odometryOnly = true;
+      else if (option == 'b')        // テキスト形式のログをバイナリ形式に変換
+        convertOnly = true;
+      else if (option == 'a')        // ループ閉じ込みを別スレッドで行う
+        asyncBackEnd = true;
     }
     if (argc == 2) {
       printf("Error: no file name.\n");
@@ -56,6 +64,15 @@ int main(int argc, char *argv[]) {
   printf("SlamLauncher: startN=%d, scanCheck=%d, odometryOnly=%d\n", startN, scanCheck, odometryOnly);
   printf("filename=%s\n", filename);
 
+  // バイナリ形式に変換する場合は、filename.lsbに書いて終了
+  if (convertOnly) {
+    std::string binPath = std::string(filename) + ".lsb";
+    bool flag = SensorDataBinary::convertTextLog(filename, binPath.c_str());
+    if (flag)
+      printf("converted: %s\n", binPath.c_str());
+    return(flag ? 0 : 1);
+  }
+
   // ファイルを開く
   SlamLauncher sl;
   bool flag = sl.setFilename(filename);
@@ -69,6 +86,7 @@ int main(int argc, char *argv[]) {
     sl.showScans();
   else {                             // スキャン表示以外はSlamLauncher内で場合分け
     sl.setOdometryOnly(odometryOnly);
+    sl.setAsyncBackEnd(asyncBackEnd);
     sl.customizeFramework();
     sl.run();
   }
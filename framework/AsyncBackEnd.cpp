@@ -0,0 +1,183 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file AsyncBackEnd.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <utility>
+#include "AsyncBackEnd.h"
+
+using namespace std;
+
+//////////
+
+// ループ検出器lと、sbackと同じ設定のバックエンドで作業スレッドを起動する。
+// ループ検出器には、フロントエンドと部品を共有させず、ポーズグラフも写しを使わせる
+void AsyncBackEnd::start(LoopDetector *l, const SlamBackEnd &sback) {
+  stop();
+
+  lpd = l;
+  lpd->detachComponents();
+  lpd->setPoseGraph(&wpg);
+  wback = sback;
+  wback.setPoseGraph(&wpg);
+  wpg.reset();
+  arcNum = 0;
+
+  stopReq = false;
+  busy = false;
+  hasPending = false;
+  hasResult = false;
+  worker = thread(&AsyncBackEnd::workLoop, this);
+}
+
+// キーフレームのスキャンscanと、そのロボット位置curPoseでのループ検出を作業スレッドに渡す。
+// pgはフロントエンドのポーズグラフで、前回から増えた分を写しに加える。
+// 作業中か、受け取っていない結果があれば、保留にしてfalseを返す。保留は最新の1つだけ残す
+bool AsyncBackEnd::submit(const Scan2D &scan, const Pose2D &curPose, int cnt, const PoseGraph *pg) {
+  if (hasPending)                                // 古い保留は、新しいキーフレームで置き換える
+    ++replaceNum;
+
+  if (!isIdle()) {
+    pendScan = scan;
+    pendCnt = cnt;
+    hasPending = true;
+    return(false);
+  }
+
+  hasPending = false;
+  jobScan = scan;
+  jobPose = curPose;
+  jobCnt = cnt;
+  startJob(pg);
+
+  return(true);
+}
+
+// 保留中のキーフレームがあり、作業スレッドが空いていて結果も受け取り済みなら、それを渡してtrueを返す。
+// ループ閉じ込みの結果を反映した後に呼ぶので、ロボット位置はポーズグラフの修正後のノードから取る
+bool AsyncBackEnd::submitPending(const PoseGraph *pg) {
+  if (!hasPending || !isIdle())
+    return(false);
+
+  hasPending = false;
+  swap(jobScan, pendScan);
+  jobPose = pg->nodes[pendCnt]->pose;            // ノードIDはスキャン番号と同じ
+  jobCnt = pendCnt;
+  startJob(pg);
+
+  return(true);
+}
+
+// 結果があれば、調整後のロボット軌跡をposesに、新しいループアークをarcsに入れてtrueを返す
+bool AsyncBackEnd::fetchResult(vector<Pose2D> &poses, vector<PoseArc> &arcs) {
+  lock_guard<mutex> lock(mtx);
+  if (!hasResult)
+    return(false);
+
+  poses.swap(resPoses);
+  arcs.swap(resArcs);
+  hasResult = false;
+
+  return(true);
+}
+
+// 作業スレッドが仕事を終えるまで待つ
+void AsyncBackEnd::waitIdle() {
+  unique_lock<mutex> lock(mtx);
+  cvIdle.wait(lock, [this] { return(!busy); });
+}
+
+// 作業スレッドを止める。仕事中なら、終わるまで待つ
+void AsyncBackEnd::stop() {
+  if (!worker.joinable())
+    return;
+
+  waitIdle();
+  {
+    lock_guard<mutex> lock(mtx);
+    stopReq = true;
+  }
+  cvJob.notify_all();
+  worker.join();
+}
+
+// 確認用
+void AsyncBackEnd::printStats() {
+  printf("AsyncBackEnd: jobs=%zu, replaced=%zu, loops=%zu\n", jobNum, replaceNum, loopNum);
+}
+
+//////////
+
+// 作業スレッドが仕事をしておらず、受け取っていない結果もないか
+bool AsyncBackEnd::isIdle() {
+  lock_guard<mutex> lock(mtx);
+  return(!busy && !hasResult);
+}
+
+// jobScan, jobPose, jobCntに入れた仕事を作業スレッドに渡す
+void AsyncBackEnd::startJob(const PoseGraph *pg) {
+  // 作業スレッドは仕事を待っているだけなので、ここで写しやループ検出器に触ってよい
+  copyGraph(pg);
+  lpd->takeSnapshot();                           // ループ検出に使う地図の写しをとる
+
+  {
+    lock_guard<mutex> lock(mtx);
+    busy = true;
+    ++jobNum;
+  }
+  cvJob.notify_one();
+}
+
+// フロントエンドのポーズグラフpgから、前回から増えたノードとオドメトリアークを写す。
+// ループアークは作業スレッドで張ってフロントエンドに渡したものなので、写さない
+void AsyncBackEnd::copyGraph(const PoseGraph *pg) {
+  for (size_t i=wpg.nodes.size(); i<pg->nodes.size(); i++)
+    wpg.addNode(pg->nodes[i]->pose);
+
+  for (size_t j=arcNum; j<pg->arcs.size(); j++) {
+    const PoseArc *a = pg->arcs[j];
+    if (a->src->nid == a->dst->nid-1)            // オドメトリアークは始点と終点が連番になっている
+      wpg.addArc(wpg.copyArc(*a));
+  }
+  arcNum = pg->arcs.size();
+}
+
+// 作業スレッドの本体。仕事が来るたびにループ検出を行い、ループが見つかればポーズ調整して結果を置く
+void AsyncBackEnd::workLoop() {
+  while (true) {
+    {
+      unique_lock<mutex> lock(mtx);
+      cvJob.wait(lock, [this] { return(stopReq || busy); });
+      if (stopReq)
+        return;
+    }
+
+    size_t an = wpg.arcs.size();                 // ループ検出前のアーク数
+    bool flag = lpd->detectLoop(&jobScan, jobPose, jobCnt);    // ループ検出を起動
+    if (flag) {
+      wback.adjustPoses();                       // ループが見つかったらポーズ調整
+      wback.updateNodes();                       // 写しのノードも修正しておく
+    }
+
+    lock_guard<mutex> lock(mtx);
+    if (flag) {
+      resPoses = wback.getNewPoses();
+      resArcs.clear();
+      for (size_t j=an; j<wpg.arcs.size(); j++)
+        resArcs.push_back(*wpg.arcs[j]);
+      hasResult = true;
+      ++loopNum;
+    }
+    busy = false;
+    cvIdle.notify_all();
+  }
+}
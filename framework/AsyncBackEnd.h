@@ -0,0 +1,99 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file AsyncBackEnd.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef ASYNC_BACK_END_H_
+#define ASYNC_BACK_END_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Scan2D.h"
+#include "PoseGraph.h"
+#include "LoopDetector.h"
+#include "SlamBackEnd.h"
+
+////////
+
+// ループ検出とポーズ調整を別スレッドで行う。
+// フロントエンドはキーフレームのスキャンと、前回から増えたノードとオドメトリアークを渡すだけで、結果を待たない。
+// 作業スレッドは自分のポーズグラフの写しでループ検出とポーズ調整を行い、調整後のロボット軌跡と
+// 新しいループアークを結果として置く。フロントエンドは次のスキャンを処理する前にそれを受け取って、地図を修正する。
+// 作業中や結果を受け取る前に来たキーフレームは、最新の1つだけを保留しておき、作業スレッドが空いたら渡す。
+// 待ち行列は作らないので、追跡は待たされず、古い保留は新しいキーフレームで置き換わる。
+class AsyncBackEnd
+{
+private:
+  LoopDetector *lpd;                     // ループ検出器。作業スレッドだけが使う
+  PoseGraph wpg;                         // ポーズグラフの写し。作業スレッドが使う
+  SlamBackEnd wback;                     // 作業スレッド用のバックエンド
+  size_t arcNum;                         // フロントエンドのポーズグラフから、写し終えたアークの数
+
+  std::thread worker;                    // 作業スレッド
+  std::mutex mtx;
+  std::condition_variable cvJob;         // 仕事が来たことを作業スレッドに知らせる
+  std::condition_variable cvIdle;        // 仕事が終わったことをフロントエンドに知らせる
+  bool stopReq;                          // 作業スレッドの停止要求
+
+  // 仕事。busyの間は作業スレッドだけが触る
+  bool busy;                             // 仕事を渡してから、終わるまでtrue
+  Scan2D jobScan;                        // キーフレームのスキャン
+  Pose2D jobPose;                        // そのロボット位置
+  int jobCnt;                            // そのスキャン番号
+
+  // 保留中のキーフレーム。フロントエンドだけが触る
+  bool hasPending;                       // 保留中のキーフレームがあるか
+  Scan2D pendScan;                       // そのスキャン
+  int pendCnt;                           // そのスキャン番号。ロボット位置は渡すときにポーズグラフから取る
+
+  // 結果。hasResultの間はフロントエンドだけが触る
+  bool hasResult;                        // 受け取っていない結果があるか
+  std::vector<Pose2D> resPoses;          // ポーズ調整後のロボット軌跡。仕事を渡した時点のノードの分だけある
+  std::vector<PoseArc> resArcs;          // 新しいループアーク。始点と終点はwpgのノードを指す
+
+  // 統計（確認用）
+  size_t jobNum;                         // 渡した仕事の数
+  size_t replaceNum;                     // 保留中に新しいキーフレームが来て、置き換えた数
+  size_t loopNum;                        // ループを検出した回数
+
+public:
+  AsyncBackEnd() : lpd(nullptr), arcNum(0), stopReq(false), busy(false), jobCnt(0), hasPending(false), pendCnt(0), hasResult(false), jobNum(0), replaceNum(0), loopNum(0) {
+  }
+
+  ~AsyncBackEnd() {
+    stop();
+  }
+
+  bool isRunning() const {
+    return(worker.joinable());
+  }
+
+////////
+
+  void start(LoopDetector *l, const SlamBackEnd &sback);
+  bool submit(const Scan2D &scan, const Pose2D &curPose, int cnt, const PoseGraph *pg);
+  bool submitPending(const PoseGraph *pg);
+  bool fetchResult(std::vector<Pose2D> &poses, std::vector<PoseArc> &arcs);
+  void waitIdle();
+  void stop();
+  void printStats();
+
+private:
+  bool isIdle();
+  void startJob(const PoseGraph *pg);
+  void copyGraph(const PoseGraph *pg);
+  void workLoop();
+};
+
+#endif
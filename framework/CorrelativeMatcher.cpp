@@ -0,0 +1,207 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file CorrelativeMatcher.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <algorithm>
+#include "CorrelativeMatcher.h"
+
+using namespace std;
+
+/////////
+
+// 参照点群refLpsから尤度格子と、その粗い階層の格子を作る
+void CorrelativeMatcher::setRefPoints(const vector<LPoint2D> &refLps) {
+  grids.clear();
+  nx = ny = 0;
+  if (refLps.empty())
+    return;
+
+  // 点群の範囲に、尤度を入れる範囲を加えた領域にする
+  int r = static_cast<int>(ceil(3*sigma/csize));
+  int xa = cellIndex(refLps[0].x), xb = xa;
+  int ya = cellIndex(refLps[0].y), yb = ya;
+  for (size_t i=1; i<refLps.size(); i++) {
+    int xi = cellIndex(refLps[i].x);
+    int yi = cellIndex(refLps[i].y);
+    xa = min(xa, xi);
+    xb = max(xb, xi);
+    ya = min(ya, yi);
+    yb = max(yb, yi);
+  }
+  xmin = xa - r;
+  ymin = ya - r;
+  nx = xb - xa + 2*r + 1;
+  ny = yb - ya + 2*r + 1;
+
+  // 元の格子。各セルの値は、セル中心から最も近い点までの距離dについてexp(-d^2/(2 sigma^2))
+  grids.resize(levelNum);
+  vector<float> &g0 = grids[0];
+  g0.assign(static_cast<size_t>(nx)*ny, 0);
+  double s2 = 2*sigma*sigma;
+  for (size_t i=0; i<refLps.size(); i++) {
+    const LPoint2D &lp = refLps[i];
+    int cx = cellIndex(lp.x);
+    int cy = cellIndex(lp.y);
+    for (int yi=cy-r; yi<=cy+r; yi++) {
+      double dy = (yi + 0.5)*csize - lp.y;
+      size_t k0 = static_cast<size_t>(yi - ymin)*nx;
+      for (int xi=cx-r; xi<=cx+r; xi++) {
+        double dx = (xi + 0.5)*csize - lp.x;
+        float v = static_cast<float>(exp(-(dx*dx + dy*dy)/s2));
+        size_t k = k0 + (xi - xmin);
+        if (v > g0[k])
+          g0[k] = v;
+      }
+    }
+  }
+
+  // 階層hの格子の値は、元の格子の[x, x+2^h) x [y, y+2^h)の最大値。1つ下の階層の4セルから求める
+  for (int h=1; h<levelNum; h++) {
+    const vector<float> &gp = grids[h-1];
+    vector<float> &g = grids[h];
+    g.resize(gp.size());
+    int s = 1 << (h-1);
+    for (int yi=0; yi<ny; yi++) {
+      for (int xi=0; xi<nx; xi++) {
+        size_t k = static_cast<size_t>(yi)*nx + xi;
+        float v = gp[k];
+        if (xi+s < nx)
+          v = max(v, gp[k+s]);
+        if (yi+s < ny) {
+          v = max(v, gp[k+s*nx]);
+          if (xi+s < nx)
+            v = max(v, gp[k+s*nx+s]);
+        }
+        g[k] = v;
+      }
+    }
+  }
+}
+
+// 現在スキャンの点群lpsについて、初期位置initPoseから並進rangeT[m]、回転rangeA[度]の範囲で、
+// スコアが最大になる位置bestPoseを求める。スコアがminScore以上の位置がなければfalseを返す
+bool CorrelativeMatcher::findPose(const vector<LPoint2D> &lps, const Pose2D &initPose, double rangeT, double rangeA, Pose2D &bestPose, double &bestScore) {
+  if (lps.empty() || nx == 0)
+    return(false);
+
+  // 回転の刻みは、最も遠い点がほぼ1セル動く角度にする
+  double dmax = 0;
+  for (size_t i=0; i<lps.size(); i++)
+    dmax = max(dmax, lps[i].x*lps[i].x + lps[i].y*lps[i].y);
+  dmax = sqrt(dmax);
+  double da = (dmax > csize) ? RAD2DEG(acos(1 - csize*csize/(2*dmax*dmax))) : rangeA;
+  if (!(da > 0))
+    da = 1;
+  int na = static_cast<int>(ceil(rangeA/da));
+  wt = static_cast<int>(ceil(rangeT/csize));
+
+  // 角度ごとに、初期位置で回転させた点のセル位置を求めておく
+  rotXs.resize(2*na+1);
+  rotYs.resize(2*na+1);
+  for (int ai=0; ai<=2*na; ai++) {
+    double a = DEG2RAD(initPose.th + (ai - na)*da);
+    double cs = cos(a);
+    double sn = sin(a);
+    vector<int> &xs = rotXs[ai];
+    vector<int> &ys = rotYs[ai];
+    xs.resize(lps.size());
+    ys.resize(lps.size());
+    for (size_t i=0; i<lps.size(); i++) {
+      const LPoint2D &lp = lps[i];
+      xs[i] = cellIndex(cs*lp.x - sn*lp.y + initPose.tx);
+      ys[i] = cellIndex(sn*lp.x + cs*lp.y + initPose.ty);
+    }
+  }
+
+  // 最も粗い階層で探索範囲を覆う候補を作り、スコアの高い順に調べる
+  nodeNum = 0;
+  int top = levelNum-1;
+  int step = 1 << top;
+  vector<Candidate> cands;
+  for (int ai=0; ai<=2*na; ai++) {
+    for (int yo=-wt; yo<=wt; yo+=step) {
+      for (int xo=-wt; xo<=wt; xo+=step)
+        cands.emplace_back(ai, xo, yo, top, scoreCandidate(ai, xo, yo, top));
+    }
+  }
+  sort(cands.begin(), cands.end());
+
+  best = Candidate(-1, 0, 0, 0, minScore);
+  for (size_t i=0; i<cands.size(); i++) {
+    if (cands[i].score <= best.score)                // 残りはこれ以上よくならない
+      break;
+    branch(cands[i]);
+  }
+
+  printf("CorrelativeMatcher: angles=%d, nodeNum=%zu, score=%g\n", 2*na+1, nodeNum, best.ai >= 0 ? best.score : 0);   // 確認用
+
+  if (best.ai < 0)
+    return(false);
+
+  bestPose.setVal(initPose.tx + best.xo*csize, initPose.ty + best.yo*csize, MyUtil::add(initPose.th, (best.ai - na)*da));
+  bestScore = best.score;
+
+  return(true);
+}
+
+// 候補cを4つに分けて、スコアの高い順に調べる。最も細かい階層まで来たら最良解を更新する
+void CorrelativeMatcher::branch(const Candidate &c) {
+  if (c.h == 0) {
+    if (c.score > best.score)
+      best = c;
+    return;
+  }
+
+  int h = c.h - 1;
+  int s = 1 << h;
+  vector<Candidate> children;
+  for (int dy=0; dy<=s; dy+=s) {
+    for (int dx=0; dx<=s; dx+=s) {
+      int xo = c.xo + dx;
+      int yo = c.yo + dy;
+      if (xo > wt || yo > wt)                          // 探索範囲の外
+        continue;
+      children.emplace_back(c.ai, xo, yo, h, scoreCandidate(c.ai, xo, yo, h));
+    }
+  }
+  sort(children.begin(), children.end());
+
+  for (size_t i=0; i<children.size(); i++) {
+    if (children[i].score <= best.score)
+      break;
+    branch(children[i]);
+  }
+}
+
+// 角度番号aiの点群を(xo, yo)だけずらしたときの、階層hの格子でのスコアを求める。
+// 階層hの格子は2^hセル四方の最大値なので、(xo, yo)から2^hセル四方のずれのスコアの上限になる
+double CorrelativeMatcher::scoreCandidate(int ai, int xo, int yo, int h) {
+  ++nodeNum;
+
+  const vector<float> &g = grids[h];
+  const vector<int> &xs = rotXs[ai];
+  const vector<int> &ys = rotYs[ai];
+  int s = 1 << h;
+  double sum = 0;
+  for (size_t i=0; i<xs.size(); i++) {
+    int x = xs[i] + xo - xmin;
+    int y = ys[i] + yo - ymin;
+    if (x >= nx || y >= ny || x+s <= 0 || y+s <= 0)  // 範囲の外
+      continue;
+    x = max(x, 0);                                   // 左下にはみ出す分は、格子の端の値で上限をとる
+    y = max(y, 0);
+    sum += g[static_cast<size_t>(y)*nx + x];
+  }
+
+  return(sum/xs.size());
+}
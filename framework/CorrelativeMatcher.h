@@ -0,0 +1,100 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file CorrelativeMatcher.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef CORRELATIVE_MATCHER_H_
+#define CORRELATIVE_MATCHER_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "LPoint2D.h"
+#include "Pose2D.h"
+
+///////
+
+// 相関によるスキャンマッチング。初期位置の誤差が大きく、ICPが収束しないときに使う。
+// 参照点群から、点の近くほど値が大きい格子（尤度格子）を作り、現在スキャンの点の位置の値の平均をスコアにする。
+// 探索範囲の全位置を調べる代わりに、2^h x 2^hセルの最大値をとった粗い格子を階層ごとに作っておき、
+// 粗い階層のスコア（細かい階層のスコアの上限になる）で見込みのない範囲を打ち切る分枝限定法で探す。
+class CorrelativeMatcher
+{
+private:
+  // 探索候補。角度番号ai、並進のずれ(xo, yo)[セル]から2^hセル四方の範囲を表す
+  struct Candidate {
+    int ai;
+    int xo, yo;
+    int h;
+    double score;                     // 範囲内のスコアの上限。h=0ならスコアそのもの
+
+    Candidate(int a, int x, int y, int l, double s) : ai(a), xo(x), yo(y), h(l), score(s) {
+    }
+
+    bool operator<(const Candidate &c) const {    // スコアの高い順に並べる
+      return(score > c.score);
+    }
+  };
+
+  double csize;                       // 最も細かい格子のセルサイズ[m]
+  double sigma;                       // 尤度の広がり[m]
+  int levelNum;                       // 格子の階層数
+  double minScore;                    // スコアがこれより低い位置は解にしない
+
+  int xmin, ymin;                     // 左下のセルの位置
+  int nx, ny;                         // 横と縦のセル数
+  std::vector<std::vector<float>> grids;    // 各階層の格子。grids[h]は2^h x 2^hセルの最大値。grids[0]が元の尤度
+
+  std::vector<std::vector<int>> rotXs;      // 角度ごとの、回転した現在スキャンの点のセル位置x
+  std::vector<std::vector<int>> rotYs;      // 角度ごとの、回転した現在スキャンの点のセル位置y
+  int wt;                             // 並進の探索範囲[セル]
+  Candidate best;                     // 探索中の最良解
+  size_t nodeNum;                     // スコアを計算した候補の数。確認用
+
+public:
+  CorrelativeMatcher() : csize(0.05), sigma(0.05), levelNum(6), minScore(0.5), xmin(0), ymin(0), nx(0), ny(0), wt(0), best(0, 0, 0, 0, 0), nodeNum(0) {
+  }
+
+  ~CorrelativeMatcher() {
+  }
+
+  void setCellSize(double c) {
+    csize = c;
+  }
+
+  void setSigma(double s) {
+    sigma = s;
+  }
+
+  void setLevelNum(int n) {
+    levelNum = (n > 0) ? n : 1;
+  }
+
+  void setMinScore(double s) {
+    minScore = s;
+  }
+
+////////
+
+  void setRefPoints(const std::vector<LPoint2D> &refLps);
+  bool findPose(const std::vector<LPoint2D> &lps, const Pose2D &initPose, double rangeT, double rangeA, Pose2D &bestPose, double &bestScore);
+
+private:
+  // 位置[m]からセルの位置を求める。負の位置でも切り下げにする
+  int cellIndex(double v) const {
+    return(static_cast<int>(floor(v/csize)));
+  }
+
+  double scoreCandidate(int ai, int xo, int yo, int h);
+  void branch(const Candidate &c);
+};
+
+#endif
@@ -20,12 +20,13 @@
 #include "LPoint2D.h"
 #include "Pose2D.h"
 #include "Scan2D.h"
+#include "PointCloud2D.h"
 
 class CostFunction
 {
 protected:
-  std::vector<const LPoint2D*> curLps;         // 対応がとれた現在スキャンの点群
-  std::vector<const LPoint2D*> refLps;         // 対応がとれた参照スキャンの点群
+  PointCloud2D curPc;                          // 対応がとれた現在スキャンの点群。成分ごとの配列
+  PointCloud2D refPc;                          // 対応がとれた参照スキャンの点群。成分ごとの配列
   double evlimit;                              // マッチングで対応がとれたと見なす距離閾値
   double pnrate;                               // 誤差がevlimit以内で対応がとれた点の比率
 
@@ -33,7 +34,7 @@ public:
   CostFunction() : evlimit(0), pnrate(0) {
   }
 
-  ~CostFunction() {
+  virtual ~CostFunction() {
   }
 
 ///////
@@ -42,10 +43,11 @@ public:
     evlimit = e;
   }
 
-  // DataAssociatorで対応のとれた点群cur, refを設定
+  // DataAssociatorで対応のとれた点群cur, refを設定。
+  // calValueは1回の設定につき何度も呼ばれるので、ここで連続した配列に集めておく
   void setPoints(std::vector<const LPoint2D*> &cur, std::vector<const LPoint2D*> &ref) {
-    curLps = cur;
-    refLps = ref;
+    curPc.setPoints(cur);
+    refPc.setPoints(ref);
   }
 
   double getPnrate() {
@@ -54,6 +56,9 @@ public:
 
 ///////////
 
+  // 同じ設定の複製を作る。別スレッドで並列に使うときに、スレッドごとに1つずつ持たせる
+  virtual CostFunction *clone() const = 0;
+
   virtual double calValue(double tx, double ty, double th) = 0;
 
 };
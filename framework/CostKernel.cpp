@@ -0,0 +1,625 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file CostKernel.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <cstdint>
+#include "CostKernel.h"
+
+// SSE2はx86-64なら必ず使える。AVX2は関数ごとに有効にして、実行時に使えるか調べる
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COST_KERNEL_X86
+#define COST_KERNEL_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define COST_KERNEL_X86
+#define COST_KERNEL_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+static_assert(sizeof(ptype) == sizeof(int32_t), "ptype must be 32 bits for the SIMD kernels");
+
+CostKernel::SimdType CostKernel::simdType = CostKernel::detectSimdType();
+
+static const int BIT_NUM[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};   // 4ビットのマスクの1の数
+
+////////
+
+// このCPUで使える一番新しい命令セットを調べる
+CostKernel::SimdType CostKernel::detectSimdType() {
+#if defined(COST_KERNEL_X86) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return(SIMD_AVX2);
+  if (__builtin_cpu_supports("sse2"))
+    return(SIMD_SSE2);
+  return(SIMD_SCALAR);
+#elif defined(COST_KERNEL_X86)
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (osxsave && avx && (_xgetbv(0) & 6) == 6) {           // OSがAVXのレジスタを保存するか
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5))
+      return(SIMD_AVX2);
+  }
+  return(SIMD_SSE2);
+#else
+  return(SIMD_SCALAR);
+#endif
+}
+
+// 使う命令セットを指定する。CPUが対応していない場合は、使える範囲に下げる
+void CostKernel::setSimdType(SimdType t) {
+  SimdType maxType = detectSimdType();
+  simdType = (t <= maxType) ? t : maxType;
+}
+
+const char *CostKernel::getSimdName(SimdType t) {
+  if (t == SIMD_AVX2)
+    return("AVX2");
+  else if (t == SIMD_SSE2)
+    return("SSE2");
+  else
+    return("scalar");
+}
+
+////////// 垂直距離 //////////
+
+// 垂直距離の2乗の合計を返す。直線上の参照点（type==LINE）だけを使い、その数をnnに入れる。
+// 垂直距離がevlimit以下の点の数をpnに入れる。aは回転角[rad]
+static double sumPDistanceScalar(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn, int &nn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  double error=0;
+  pn = nn = 0;
+  for (size_t i=0; i<cur.size(); i++) {
+    if (ref.type[i] != LINE)                      // 直線上の点でなければ使わない
+      continue;
+
+    double cx = cur.x[i];
+    double cy = cur.y[i];
+    double x = cs*cx - sn*cy + tx;                // 現在スキャンの点を参照スキャンの座標系に変換
+    double y = sn*cx + cs*cy + ty;
+
+    double pdis = (x - ref.x[i])*ref.nx[i] + (y - ref.y[i])*ref.ny[i];         // 垂直距離
+    double er = pdis*pdis;
+    if (er <= ev2)
+      ++pn;                                       // 誤差が小さい点の数
+
+    error += er;
+    ++nn;
+  }
+
+  return(error);
+}
+
+#ifdef COST_KERNEL_X86
+
+// SSE2版。2点ずつ計算する
+static double sumPDistanceSSE2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn, int &nn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  const double *rnxs = ref.nx.data();
+  const double *rnys = ref.ny.data();
+  const ptype *rtypes = ref.type.data();
+  size_t n = cur.size();
+
+  __m128d vcs = _mm_set1_pd(cs);
+  __m128d vsn = _mm_set1_pd(sn);
+  __m128d vtx = _mm_set1_pd(tx);
+  __m128d vty = _mm_set1_pd(ty);
+  __m128d vev2 = _mm_set1_pd(ev2);
+  __m128i vline = _mm_set1_epi32(LINE);
+  __m128d verr = _mm_setzero_pd();
+  pn = nn = 0;
+  size_t i=0;
+  for (; i+2<=n; i+=2) {
+    __m128i t32 = _mm_cmpeq_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rtypes+i)), vline);
+    __m128d line = _mm_castsi128_pd(_mm_unpacklo_epi32(t32, t32));    // 直線上の点のマスク
+    int lmask = _mm_movemask_pd(line);
+    if (lmask == 0)
+      continue;
+
+    __m128d cx = _mm_loadu_pd(cxs+i);
+    __m128d cy = _mm_loadu_pd(cys+i);
+    __m128d x = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(vcs, cx), _mm_mul_pd(vsn, cy)), vtx);
+    __m128d y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vsn, cx), _mm_mul_pd(vcs, cy)), vty);
+    __m128d pdis = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(x, _mm_loadu_pd(rxs+i)), _mm_loadu_pd(rnxs+i)),
+                              _mm_mul_pd(_mm_sub_pd(y, _mm_loadu_pd(rys+i)), _mm_loadu_pd(rnys+i)));
+    __m128d er = _mm_and_pd(_mm_mul_pd(pdis, pdis), line);
+    verr = _mm_add_pd(verr, er);
+    nn += BIT_NUM[lmask];
+    pn += BIT_NUM[_mm_movemask_pd(_mm_and_pd(_mm_cmple_pd(er, vev2), line))];
+  }
+  alignas(16) double es[2];
+  _mm_store_pd(es, verr);
+  double error = es[0] + es[1];
+
+  // 残りの点
+  for (; i<n; i++) {
+    if (rtypes[i] != LINE)
+      continue;
+    double x = cs*cxs[i] - sn*cys[i] + tx;
+    double y = sn*cxs[i] + cs*cys[i] + ty;
+    double pdis = (x - rxs[i])*rnxs[i] + (y - rys[i])*rnys[i];
+    double er = pdis*pdis;
+    if (er <= ev2)
+      ++pn;
+    error += er;
+    ++nn;
+  }
+
+  return(error);
+}
+
+// AVX2版。4点ずつ計算する
+COST_KERNEL_AVX2
+static double sumPDistanceAVX2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn, int &nn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  const double *rnxs = ref.nx.data();
+  const double *rnys = ref.ny.data();
+  const ptype *rtypes = ref.type.data();
+  size_t n = cur.size();
+
+  __m256d vcs = _mm256_set1_pd(cs);
+  __m256d vsn = _mm256_set1_pd(sn);
+  __m256d vtx = _mm256_set1_pd(tx);
+  __m256d vty = _mm256_set1_pd(ty);
+  __m256d vev2 = _mm256_set1_pd(ev2);
+  __m128i vline = _mm_set1_epi32(LINE);
+  __m256d verr = _mm256_setzero_pd();
+  pn = nn = 0;
+  size_t i=0;
+  for (; i+4<=n; i+=4) {
+    __m128i t32 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rtypes+i)), vline);
+    __m256d line = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(t32));    // 直線上の点のマスク
+    int lmask = _mm256_movemask_pd(line);
+    if (lmask == 0)
+      continue;
+
+    __m256d cx = _mm256_loadu_pd(cxs+i);
+    __m256d cy = _mm256_loadu_pd(cys+i);
+    __m256d x = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(vcs, cx), _mm256_mul_pd(vsn, cy)), vtx);
+    __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vsn, cx), _mm256_mul_pd(vcs, cy)), vty);
+    __m256d pdis = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, _mm256_loadu_pd(rxs+i)), _mm256_loadu_pd(rnxs+i)),
+                                 _mm256_mul_pd(_mm256_sub_pd(y, _mm256_loadu_pd(rys+i)), _mm256_loadu_pd(rnys+i)));
+    __m256d er = _mm256_and_pd(_mm256_mul_pd(pdis, pdis), line);
+    verr = _mm256_add_pd(verr, er);
+    nn += BIT_NUM[lmask];
+    pn += BIT_NUM[_mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(er, vev2, _CMP_LE_OQ), line))];
+  }
+  alignas(32) double es[4];
+  _mm256_store_pd(es, verr);
+  double error = (es[0] + es[1]) + (es[2] + es[3]);
+
+  // 残りの点
+  for (; i<n; i++) {
+    if (rtypes[i] != LINE)
+      continue;
+    double x = cs*cxs[i] - sn*cys[i] + tx;
+    double y = sn*cxs[i] + cs*cys[i] + ty;
+    double pdis = (x - rxs[i])*rnxs[i] + (y - rys[i])*rnys[i];
+    double er = pdis*pdis;
+    if (er <= ev2)
+      ++pn;
+    error += er;
+    ++nn;
+  }
+
+  return(error);
+}
+
+#endif
+
+double CostKernel::sumPDistance(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn, int &nn) {
+#ifdef COST_KERNEL_X86
+  if (simdType == SIMD_AVX2)
+    return(sumPDistanceAVX2(cur, ref, tx, ty, a, evlimit, pn, nn));
+  else if (simdType == SIMD_SSE2)
+    return(sumPDistanceSSE2(cur, ref, tx, ty, a, evlimit, pn, nn));
+#endif
+  return(sumPDistanceScalar(cur, ref, tx, ty, a, evlimit, pn, nn));
+}
+
+////////// 点間距離 //////////
+
+// 点間距離の2乗の合計を返す。点間距離がevlimit以下の点の数をpnに入れる。aは回転角[rad]
+static double sumEDistanceScalar(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  double error=0;
+  pn = 0;
+  for (size_t i=0; i<cur.size(); i++) {
+    double cx = cur.x[i];
+    double cy = cur.y[i];
+    double x = cs*cx - sn*cy + tx;                // 現在スキャンの点を参照スキャンの座標系に変換
+    double y = sn*cx + cs*cy + ty;
+
+    double edis = (x - ref.x[i])*(x - ref.x[i]) + (y - ref.y[i])*(y - ref.y[i]);     // 点間距離
+    if (edis <= ev2)
+      ++pn;                                       // 誤差が小さい点の数
+
+    error += edis;
+  }
+
+  return(error);
+}
+
+#ifdef COST_KERNEL_X86
+
+// SSE2版。2点ずつ計算する
+static double sumEDistanceSSE2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  size_t n = cur.size();
+
+  __m128d vcs = _mm_set1_pd(cs);
+  __m128d vsn = _mm_set1_pd(sn);
+  __m128d vtx = _mm_set1_pd(tx);
+  __m128d vty = _mm_set1_pd(ty);
+  __m128d vev2 = _mm_set1_pd(ev2);
+  __m128d verr = _mm_setzero_pd();
+  pn = 0;
+  size_t i=0;
+  for (; i+2<=n; i+=2) {
+    __m128d cx = _mm_loadu_pd(cxs+i);
+    __m128d cy = _mm_loadu_pd(cys+i);
+    __m128d dx = _mm_sub_pd(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(vcs, cx), _mm_mul_pd(vsn, cy)), vtx), _mm_loadu_pd(rxs+i));
+    __m128d dy = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(vsn, cx), _mm_mul_pd(vcs, cy)), vty), _mm_loadu_pd(rys+i));
+    __m128d edis = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    verr = _mm_add_pd(verr, edis);
+    pn += BIT_NUM[_mm_movemask_pd(_mm_cmple_pd(edis, vev2))];
+  }
+  alignas(16) double es[2];
+  _mm_store_pd(es, verr);
+  double error = es[0] + es[1];
+
+  // 残りの点
+  for (; i<n; i++) {
+    double dx = cs*cxs[i] - sn*cys[i] + tx - rxs[i];
+    double dy = sn*cxs[i] + cs*cys[i] + ty - rys[i];
+    double edis = dx*dx + dy*dy;
+    if (edis <= ev2)
+      ++pn;
+    error += edis;
+  }
+
+  return(error);
+}
+
+// AVX2版。4点ずつ計算する
+COST_KERNEL_AVX2
+static double sumEDistanceAVX2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double ev2 = evlimit*evlimit;
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  size_t n = cur.size();
+
+  __m256d vcs = _mm256_set1_pd(cs);
+  __m256d vsn = _mm256_set1_pd(sn);
+  __m256d vtx = _mm256_set1_pd(tx);
+  __m256d vty = _mm256_set1_pd(ty);
+  __m256d vev2 = _mm256_set1_pd(ev2);
+  __m256d verr = _mm256_setzero_pd();
+  pn = 0;
+  size_t i=0;
+  for (; i+4<=n; i+=4) {
+    __m256d cx = _mm256_loadu_pd(cxs+i);
+    __m256d cy = _mm256_loadu_pd(cys+i);
+    __m256d dx = _mm256_sub_pd(_mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(vcs, cx), _mm256_mul_pd(vsn, cy)), vtx), _mm256_loadu_pd(rxs+i));
+    __m256d dy = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vsn, cx), _mm256_mul_pd(vcs, cy)), vty), _mm256_loadu_pd(rys+i));
+    __m256d edis = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    verr = _mm256_add_pd(verr, edis);
+    pn += BIT_NUM[_mm256_movemask_pd(_mm256_cmp_pd(edis, vev2, _CMP_LE_OQ))];
+  }
+  alignas(32) double es[4];
+  _mm256_store_pd(es, verr);
+  double error = (es[0] + es[1]) + (es[2] + es[3]);
+
+  // 残りの点
+  for (; i<n; i++) {
+    double dx = cs*cxs[i] - sn*cys[i] + tx - rxs[i];
+    double dy = sn*cxs[i] + cs*cys[i] + ty - rys[i];
+    double edis = dx*dx + dy*dy;
+    if (edis <= ev2)
+      ++pn;
+    error += edis;
+  }
+
+  return(error);
+}
+
+#endif
+
+double CostKernel::sumEDistance(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn) {
+#ifdef COST_KERNEL_X86
+  if (simdType == SIMD_AVX2)
+    return(sumEDistanceAVX2(cur, ref, tx, ty, a, evlimit, pn));
+  else if (simdType == SIMD_SSE2)
+    return(sumEDistanceSSE2(cur, ref, tx, ty, a, evlimit, pn));
+#endif
+  return(sumEDistanceScalar(cur, ref, tx, ty, a, evlimit, pn));
+}
+
+////////// ガウスニュートン法の正規方程式 //////////
+
+// 垂直距離を誤差とするガウスニュートン法の正規方程式 (J^T W J) d = -J^T W e の係数を、1回の走査で累積する。
+// 参照点の法線をn、回転のヤコビ行列の列を(j0, j1)とすると、W=n n^Tなので、
+//   g = J^T n = (nx, ny, nx*j0 + ny*j1),  r = n^T e
+// とおけば、J^T W J = g g^T、J^T W e = g r、e^T W e = r^2 となる。これにロバスト関数の重みwをかけて足す。
+// Hには対称行列J^T W Jの上三角 (00,01,02,11,12,22)、bにはJ^T W eを入れる。
+// 直線上の参照点（type==LINE）だけを使う。重みつき誤差の合計を返す。aは回転角[rad]
+
+// i番目の点の分をHとbに足す
+static inline double accumulatePoint(const PointCloud2D &cur, const PointCloud2D &ref, size_t i, double cs, double sn, double tx, double ty, CostKernel::RobustType rtype, double evlimit, double H[6], double b[3]) {
+  double cx = cur.x[i];
+  double cy = cur.y[i];
+  double nx = ref.nx[i];
+  double ny = ref.ny[i];
+  double ex = cs*cx - sn*cy + tx - ref.x[i];     // 現在スキャンの点を参照スキャンの座標系に変換した誤差
+  double ey = sn*cx + cs*cy + ty - ref.y[i];
+  double r = nx*ex + ny*ey;                      // 垂直距離
+  double g2 = nx*(-sn*cx - cs*cy) + ny*(cs*cx - sn*cy);
+  double err = r*r;
+  double w = CostKernel::robustWeight(err, rtype, evlimit);
+
+  H[0] += w*nx*nx;
+  H[1] += w*nx*ny;
+  H[2] += w*nx*g2;
+  H[3] += w*ny*ny;
+  H[4] += w*ny*g2;
+  H[5] += w*g2*g2;
+  b[0] += w*nx*r;
+  b[1] += w*ny*r;
+  b[2] += w*g2*r;
+
+  return(w*err);
+}
+
+static double accumulateNormalEqScalar(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, CostKernel::RobustType rtype, double evlimit, double H[6], double b[3]) {
+  double cs = cos(a);
+  double sn = sin(a);
+  double error=0;
+  for (size_t i=0; i<cur.size(); i++) {
+    if (ref.type[i] != LINE)                     // 直線上の点でなければ使わない
+      continue;
+    error += accumulatePoint(cur, ref, i, cs, sn, tx, ty, rtype, evlimit, H, b);
+  }
+
+  return(error);
+}
+
+#ifdef COST_KERNEL_X86
+
+// SSE2版。2点ずつ計算する
+static double accumulateNormalEqSSE2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, CostKernel::RobustType rtype, double evlimit, double H[6], double b[3]) {
+  double cs = cos(a);
+  double sn = sin(a);
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  const double *rnxs = ref.nx.data();
+  const double *rnys = ref.ny.data();
+  const ptype *rtypes = ref.type.data();
+  size_t n = cur.size();
+
+  __m128d vcs = _mm_set1_pd(cs);
+  __m128d vsn = _mm_set1_pd(sn);
+  __m128d vtx = _mm_set1_pd(tx);
+  __m128d vty = _mm_set1_pd(ty);
+  __m128d vev = _mm_set1_pd(evlimit);
+  __m128d vev2 = _mm_set1_pd(evlimit*evlimit);
+  __m128d one = _mm_set1_pd(1.0);
+  __m128i vline = _mm_set1_epi32(LINE);
+  __m128d acc[10];                               // H[0..5], b[0..2], 誤差の順
+  for (int k=0; k<10; k++)
+    acc[k] = _mm_setzero_pd();
+  size_t i=0;
+  for (; i+2<=n; i+=2) {
+    __m128i t32 = _mm_cmpeq_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rtypes+i)), vline);
+    __m128d line = _mm_castsi128_pd(_mm_unpacklo_epi32(t32, t32));    // 直線上の点のマスク
+    if (_mm_movemask_pd(line) == 0)
+      continue;
+
+    __m128d cx = _mm_loadu_pd(cxs+i);
+    __m128d cy = _mm_loadu_pd(cys+i);
+    __m128d nx = _mm_loadu_pd(rnxs+i);
+    __m128d ny = _mm_loadu_pd(rnys+i);
+    __m128d ex = _mm_sub_pd(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(vcs, cx), _mm_mul_pd(vsn, cy)), vtx), _mm_loadu_pd(rxs+i));
+    __m128d ey = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(vsn, cx), _mm_mul_pd(vcs, cy)), vty), _mm_loadu_pd(rys+i));
+    __m128d r = _mm_add_pd(_mm_mul_pd(nx, ex), _mm_mul_pd(ny, ey));
+    __m128d j0 = _mm_sub_pd(_mm_setzero_pd(), _mm_add_pd(_mm_mul_pd(vsn, cx), _mm_mul_pd(vcs, cy)));
+    __m128d j1 = _mm_sub_pd(_mm_mul_pd(vcs, cx), _mm_mul_pd(vsn, cy));
+    __m128d g2 = _mm_add_pd(_mm_mul_pd(nx, j0), _mm_mul_pd(ny, j1));
+    __m128d err = _mm_mul_pd(r, r);
+
+    __m128d w = one;                             // ロバスト関数の重み
+    if (rtype == CostKernel::ROBUST_HUBER) {
+      __m128d in = _mm_cmplt_pd(err, vev2);
+      w = _mm_or_pd(_mm_and_pd(in, one), _mm_andnot_pd(in, _mm_div_pd(vev, _mm_sqrt_pd(err))));
+    }
+    else if (rtype == CostKernel::ROBUST_TUKEY) {
+      __m128d t = _mm_sub_pd(one, _mm_div_pd(err, vev2));
+      w = _mm_and_pd(_mm_cmplt_pd(err, vev2), _mm_mul_pd(t, t));
+    }
+    w = _mm_and_pd(w, line);                     // 直線上でない点は重み0
+
+    __m128d wnx = _mm_mul_pd(w, nx);
+    __m128d wny = _mm_mul_pd(w, ny);
+    __m128d wg2 = _mm_mul_pd(w, g2);
+    acc[0] = _mm_add_pd(acc[0], _mm_mul_pd(wnx, nx));
+    acc[1] = _mm_add_pd(acc[1], _mm_mul_pd(wnx, ny));
+    acc[2] = _mm_add_pd(acc[2], _mm_mul_pd(wnx, g2));
+    acc[3] = _mm_add_pd(acc[3], _mm_mul_pd(wny, ny));
+    acc[4] = _mm_add_pd(acc[4], _mm_mul_pd(wny, g2));
+    acc[5] = _mm_add_pd(acc[5], _mm_mul_pd(wg2, g2));
+    acc[6] = _mm_add_pd(acc[6], _mm_mul_pd(wnx, r));
+    acc[7] = _mm_add_pd(acc[7], _mm_mul_pd(wny, r));
+    acc[8] = _mm_add_pd(acc[8], _mm_mul_pd(wg2, r));
+    acc[9] = _mm_add_pd(acc[9], _mm_mul_pd(w, err));
+  }
+  alignas(16) double v[2];
+  for (int k=0; k<6; k++) {
+    _mm_store_pd(v, acc[k]);
+    H[k] += v[0] + v[1];
+  }
+  for (int k=0; k<3; k++) {
+    _mm_store_pd(v, acc[6+k]);
+    b[k] += v[0] + v[1];
+  }
+  _mm_store_pd(v, acc[9]);
+  double error = v[0] + v[1];
+
+  // 残りの点
+  for (; i<n; i++) {
+    if (rtypes[i] != LINE)
+      continue;
+    error += accumulatePoint(cur, ref, i, cs, sn, tx, ty, rtype, evlimit, H, b);
+  }
+
+  return(error);
+}
+
+// AVX2版。4点ずつ計算する
+COST_KERNEL_AVX2
+static double accumulateNormalEqAVX2(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, CostKernel::RobustType rtype, double evlimit, double H[6], double b[3]) {
+  double cs = cos(a);
+  double sn = sin(a);
+  const double *cxs = cur.x.data();
+  const double *cys = cur.y.data();
+  const double *rxs = ref.x.data();
+  const double *rys = ref.y.data();
+  const double *rnxs = ref.nx.data();
+  const double *rnys = ref.ny.data();
+  const ptype *rtypes = ref.type.data();
+  size_t n = cur.size();
+
+  __m256d vcs = _mm256_set1_pd(cs);
+  __m256d vsn = _mm256_set1_pd(sn);
+  __m256d vtx = _mm256_set1_pd(tx);
+  __m256d vty = _mm256_set1_pd(ty);
+  __m256d vev = _mm256_set1_pd(evlimit);
+  __m256d vev2 = _mm256_set1_pd(evlimit*evlimit);
+  __m256d one = _mm256_set1_pd(1.0);
+  __m128i vline = _mm_set1_epi32(LINE);
+  __m256d acc[10];                               // H[0..5], b[0..2], 誤差の順
+  for (int k=0; k<10; k++)
+    acc[k] = _mm256_setzero_pd();
+  size_t i=0;
+  for (; i+4<=n; i+=4) {
+    __m128i t32 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rtypes+i)), vline);
+    __m256d line = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(t32));    // 直線上の点のマスク
+    if (_mm256_movemask_pd(line) == 0)
+      continue;
+
+    __m256d cx = _mm256_loadu_pd(cxs+i);
+    __m256d cy = _mm256_loadu_pd(cys+i);
+    __m256d nx = _mm256_loadu_pd(rnxs+i);
+    __m256d ny = _mm256_loadu_pd(rnys+i);
+    __m256d ex = _mm256_sub_pd(_mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(vcs, cx), _mm256_mul_pd(vsn, cy)), vtx), _mm256_loadu_pd(rxs+i));
+    __m256d ey = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vsn, cx), _mm256_mul_pd(vcs, cy)), vty), _mm256_loadu_pd(rys+i));
+    __m256d r = _mm256_add_pd(_mm256_mul_pd(nx, ex), _mm256_mul_pd(ny, ey));
+    __m256d j0 = _mm256_sub_pd(_mm256_setzero_pd(), _mm256_add_pd(_mm256_mul_pd(vsn, cx), _mm256_mul_pd(vcs, cy)));
+    __m256d j1 = _mm256_sub_pd(_mm256_mul_pd(vcs, cx), _mm256_mul_pd(vsn, cy));
+    __m256d g2 = _mm256_add_pd(_mm256_mul_pd(nx, j0), _mm256_mul_pd(ny, j1));
+    __m256d err = _mm256_mul_pd(r, r);
+
+    __m256d w = one;                             // ロバスト関数の重み
+    if (rtype == CostKernel::ROBUST_HUBER) {
+      __m256d in = _mm256_cmp_pd(err, vev2, _CMP_LT_OQ);
+      w = _mm256_blendv_pd(_mm256_div_pd(vev, _mm256_sqrt_pd(err)), one, in);
+    }
+    else if (rtype == CostKernel::ROBUST_TUKEY) {
+      __m256d t = _mm256_sub_pd(one, _mm256_div_pd(err, vev2));
+      w = _mm256_and_pd(_mm256_cmp_pd(err, vev2, _CMP_LT_OQ), _mm256_mul_pd(t, t));
+    }
+    w = _mm256_and_pd(w, line);                  // 直線上でない点は重み0
+
+    __m256d wnx = _mm256_mul_pd(w, nx);
+    __m256d wny = _mm256_mul_pd(w, ny);
+    __m256d wg2 = _mm256_mul_pd(w, g2);
+    acc[0] = _mm256_add_pd(acc[0], _mm256_mul_pd(wnx, nx));
+    acc[1] = _mm256_add_pd(acc[1], _mm256_mul_pd(wnx, ny));
+    acc[2] = _mm256_add_pd(acc[2], _mm256_mul_pd(wnx, g2));
+    acc[3] = _mm256_add_pd(acc[3], _mm256_mul_pd(wny, ny));
+    acc[4] = _mm256_add_pd(acc[4], _mm256_mul_pd(wny, g2));
+    acc[5] = _mm256_add_pd(acc[5], _mm256_mul_pd(wg2, g2));
+    acc[6] = _mm256_add_pd(acc[6], _mm256_mul_pd(wnx, r));
+    acc[7] = _mm256_add_pd(acc[7], _mm256_mul_pd(wny, r));
+    acc[8] = _mm256_add_pd(acc[8], _mm256_mul_pd(wg2, r));
+    acc[9] = _mm256_add_pd(acc[9], _mm256_mul_pd(w, err));
+  }
+  alignas(32) double v[4];
+  for (int k=0; k<6; k++) {
+    _mm256_store_pd(v, acc[k]);
+    H[k] += (v[0] + v[1]) + (v[2] + v[3]);
+  }
+  for (int k=0; k<3; k++) {
+    _mm256_store_pd(v, acc[6+k]);
+    b[k] += (v[0] + v[1]) + (v[2] + v[3]);
+  }
+  _mm256_store_pd(v, acc[9]);
+  double error = (v[0] + v[1]) + (v[2] + v[3]);
+
+  // 残りの点
+  for (; i<n; i++) {
+    if (rtypes[i] != LINE)
+      continue;
+    error += accumulatePoint(cur, ref, i, cs, sn, tx, ty, rtype, evlimit, H, b);
+  }
+
+  return(error);
+}
+
+#endif
+
+double CostKernel::accumulateNormalEq(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, RobustType rtype, double evlimit, double H[6], double b[3]) {
+  for (int k=0; k<6; k++)
+    H[k] = 0;
+  for (int k=0; k<3; k++)
+    b[k] = 0;
+#ifdef COST_KERNEL_X86
+  if (simdType == SIMD_AVX2)
+    return(accumulateNormalEqAVX2(cur, ref, tx, ty, a, rtype, evlimit, H, b));
+  else if (simdType == SIMD_SSE2)
+    return(accumulateNormalEqSSE2(cur, ref, tx, ty, a, rtype, evlimit, H, b));
+#endif
+  return(accumulateNormalEqScalar(cur, ref, tx, ty, a, rtype, evlimit, H, b));
+}
@@ -0,0 +1,64 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file CostKernel.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef COST_KERNEL_H_
+#define COST_KERNEL_H_
+
+#include "MyUtil.h"
+#include "PointCloud2D.h"
+
+////////
+
+// 対応づけた点群の誤差を、SIMD命令でまとめて計算する。
+// 使う命令セットは、実行時にCPUを調べて決める。
+class CostKernel
+{
+public:
+  enum SimdType {SIMD_SCALAR=0, SIMD_SSE2=1, SIMD_AVX2=2};      // SIMDなし、SSE2、AVX2
+  enum RobustType {ROBUST_NONE=0, ROBUST_HUBER=1, ROBUST_TUKEY=2}; // ロバスト関数なし、Huber、Tukey
+
+private:
+  static SimdType simdType;            // 使う命令セット
+
+public:
+  static SimdType getSimdType() {
+    return(simdType);
+  }
+
+  static void setSimdType(SimdType t);
+  static SimdType detectSimdType();
+  static const char *getSimdName(SimdType t);
+
+  // ロバスト関数の重み。errは誤差の2乗
+  static double robustWeight(double err, RobustType rtype, double evlimit) {
+    double ev2 = evlimit*evlimit;
+    if (rtype == ROBUST_HUBER)
+      return(err < ev2 ? 1 : evlimit/sqrt(err));
+    else if (rtype == ROBUST_TUKEY) {
+      if (err >= ev2)
+        return(0);
+      double t = 1 - err/ev2;
+      return(t*t);
+    }
+    return(1);
+  }
+
+////////
+
+  static double sumPDistance(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn, int &nn);
+  static double sumEDistance(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, double evlimit, int &pn);
+  static double accumulateNormalEq(const PointCloud2D &cur, const PointCloud2D &ref, double tx, double ty, double a, RobustType rtype, double evlimit, double H[6], double b[3]);
+};
+
+#endif
@@ -25,10 +25,8 @@ double CovarianceCalculator::calIcpCovariance(const Pose2D &pose, std::vector<co
   double ty = pose.ty;
   double th = pose.th;
   double a = DEG2RAD(th);
-  vector<double> Jx;                                         // ヤコビ行列のxの列
-  vector<double> Jy;                                         // ヤコビ行列のyの列
-  vector<double> Jt;                                         // ヤコビ行列のthの列
-
+  // ヘッセ行列の近似J^TJを、ヤコビ行列の行を求めながら累積する
+  Eigen::Matrix3d hes = Eigen::Matrix3d::Zero(3,3);          // 近似ヘッセ行列。0で初期化
   for (size_t i=0; i<curLps.size(); i++) {
     const LPoint2D *clp = curLps[i];                         // 現在スキャンの点
     const LPoint2D *rlp = refLps[i];                         // 参照スキャンの点
@@ -41,20 +39,16 @@ double CovarianceCalculator::calIcpCovariance(const Pose2D &pose, std::vector<co
     double pdy = calPDistance(clp, rlp, tx, ty+dd, a);      // yを少し変えたコスト関数値
     double pdt = calPDistance(clp, rlp, tx, ty, a+da);      // thを少し変えたコスト関数値
 
-    Jx.push_back((pdx - pd0)/dd);                            // 偏微分（x成分）
-    Jy.push_back((pdy - pd0)/dd);                            // 偏微分（y成分）
-    Jt.push_back((pdt - pd0)/da);                            // 偏微分（th成分）
-  }
+    double Jx = (pdx - pd0)/dd;                              // 偏微分（x成分）
+    double Jy = (pdy - pd0)/dd;                              // 偏微分（y成分）
+    double Jt = (pdt - pd0)/da;                              // 偏微分（th成分）
 
-  // ヘッセ行列の近似J^TJの計算
-  Eigen::Matrix3d hes = Eigen::Matrix3d::Zero(3,3);          // 近似ヘッセ行列。0で初期化
-  for (size_t i=0; i<Jx.size(); i++) {
-    hes(0,0) += Jx[i]*Jx[i];
-    hes(0,1) += Jx[i]*Jy[i];
-    hes(0,2) += Jx[i]*Jt[i];
-    hes(1,1) += Jy[i]*Jy[i];
-    hes(1,2) += Jy[i]*Jt[i];
-    hes(2,2) += Jt[i]*Jt[i];
+    hes(0,0) += Jx*Jx;
+    hes(0,1) += Jx*Jy;
+    hes(0,2) += Jx*Jt;
+    hes(1,1) += Jy*Jy;
+    hes(1,2) += Jy*Jt;
+    hes(2,2) += Jt*Jt;
   }
   // J^TJが対称行列であることを利用
   hes(1,0) = hes(0,1);
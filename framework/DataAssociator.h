@@ -16,10 +16,12 @@
 #define DATA_ASSOCIATOR_H_
 
 #include <vector>
+#include <algorithm>
 #include "MyUtil.h"
 #include "LPoint2D.h"
 #include "Pose2D.h"
 #include "Scan2D.h"
+#include "WorkerPool.h"
 
 class DataAssociator
 {
@@ -28,27 +30,171 @@ protected:
   double totalTime;                            // 調査用
   int timeCnt;                                 // 調査用
 
+  WorkerPool workers;                          // 並列に対応づけるときの作業スレッド
+  std::vector<std::vector<const LPoint2D*>> blockCurLps;   // ブロックごとの対応づけ結果。作業用
+  std::vector<std::vector<const LPoint2D*>> blockRefLps;
+
+  // ICPの繰り返しで前回の対応を使い回すためのもの
+  double reuseThre;                            // 点の移動量がこれ以下なら対応を探し直さない。0なら常に探す
+  const Scan2D *reuseScan;                     // 対応を覚えている現在スキャン。なければnullptr
+  size_t reuseSize;                            // そのときの点数
+  Pose2D reusePose;                            // 対応を探したときの予測位置
+  double reuseRange;                           // 現在スキャンの点のセンサからの最大距離
+  std::vector<const LPoint2D*> lastMatch;      // 現在スキャンの各点の対応点。なければnullptr
+  size_t searchNum;                            // 対応を探した回数。確認用
+  size_t reuseNum;                             // 対応を使い回した回数。確認用
+
 public:
   std::vector<const LPoint2D*> curLps;            // 対応がとれた現在スキャンの点群
   std::vector<const LPoint2D*> refLps;            // 対応がとれた参照スキャンの点群
 
-  DataAssociator() : dthre(0.2), totalTime(0), timeCnt(0) {
+  DataAssociator() : dthre(0.2), totalTime(0), timeCnt(0), reuseThre(0), reuseScan(nullptr), reuseSize(0), reuseRange(0), searchNum(0), reuseNum(0) {
   }
 
-  ~DataAssociator() {
+  virtual ~DataAssociator() {
   }
 
   void setDthre(double d) {
+    if (d != dthre)
+      clearReuse();
     dthre = d;
   }
 
+  double getDthre() const {
+    return(dthre);
+  }
+
+  // 対応づけに使うスレッド数。1なら並列にしない
+  void setThreadNum(size_t n) {
+    workers.setThreadNum(n);
+  }
+
+  // 前回の対応を使い回す点の移動量の上限[m]。0なら使い回さない
+  void setReuseThre(double d) {
+    reuseThre = d;
+    clearReuse();
+  }
+
+  // 覚えている対応を捨てる。参照スキャンが変わったときに呼ぶ
+  void clearReuse() {
+    reuseScan = nullptr;
+  }
+
   void averageProcTime() {
     double avg = totalTime/timeCnt;
     printf("DataAssociator: average processing time=%g\n", avg);
+    if (reuseThre > 0)
+      printf("DataAssociator: searched=%zu, reused=%zu\n", searchNum, reuseNum);
   }
 
+  // 同じ設定の新しいインスタンスを作る。参照点群と作業スレッドは引き継がない。
+  // 別スレッドで並列に対応づけるときに、スレッドごとに1つずつ持たせる
+  virtual DataAssociator *clone() const = 0;
+
   virtual void setRefBase(const std::vector<LPoint2D> &lps) = 0;
+
+  // 参照スキャンrの点を登録する。計測位置r->poseも使うクラスはこれを上書きする
+  virtual void setRefScan(const Scan2D *r) {
+    setRefBase(r->lps);
+  }
   virtual double findCorrespondence(const Scan2D *curScan, const Pose2D &predPose) = 0;
+
+protected:
+  // cloneで、基底クラスの設定をdからコピーする
+  void copySettings(const DataAssociator &d) {
+    dthre = d.dthre;
+    reuseThre = d.reuseThre;
+  }
+
+  // 前回対応を探したときから、現在スキャンの各点の移動量がreuseThre以下なら、
+  // 探し直さずに前回の対応点を使ってcurLpsとrefLpsを作り、trueを返す。
+  // 使い回す対応点も、predPoseでの距離がdthre以内かは確かめる。
+  bool reuseCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
+    if (reuseThre <= 0 || curScan != reuseScan || curScan->lps.size() != reuseSize)
+      return(false);
+
+    // 点の移動量の上限。並進の変化量と、回転の変化量による最も遠い点の移動量の和
+    double dx = predPose.tx - reusePose.tx;
+    double dy = predPose.ty - reusePose.ty;
+    double da = DEG2RAD(MyUtil::add(predPose.th, -reusePose.th));
+    double dmove = sqrt(dx*dx + dy*dy) + reuseRange*fabs(da);
+    if (dmove > reuseThre)
+      return(false);
+
+    curLps.clear();
+    refLps.clear();
+    const std::vector<LPoint2D> &lps = curScan->lps;
+    for (size_t i=0; i<lps.size(); i++) {
+      const LPoint2D *rlp = lastMatch[i];
+      if (rlp == nullptr)
+        continue;
+      LPoint2D glp;
+      predPose.globalPoint(lps[i], glp);
+      double d = (glp.x - rlp->x)*(glp.x - rlp->x) + (glp.y - rlp->y)*(glp.y - rlp->y);
+      if (d <= dthre*dthre) {
+        curLps.push_back(&lps[i]);
+        refLps.push_back(rlp);
+      }
+    }
+    ++reuseNum;
+    return(true);
+  }
+
+  // 探した対応を、現在スキャンの点ごとに覚えておく
+  void saveCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
+    ++searchNum;
+    if (reuseThre <= 0)
+      return;
+
+    const std::vector<LPoint2D> &lps = curScan->lps;
+    lastMatch.assign(lps.size(), nullptr);
+    for (size_t k=0; k<curLps.size(); k++)
+      lastMatch[curLps[k] - &lps[0]] = refLps[k];       // curLpsは現在スキャンの点を指している
+
+    reuseRange = 0;
+    for (size_t i=0; i<lps.size(); i++)
+      reuseRange = std::max(reuseRange, lps[i].x*lps[i].x + lps[i].y*lps[i].y);
+    reuseRange = sqrt(reuseRange);
+
+    reuseScan = curScan;
+    reuseSize = lps.size();
+    reusePose = predPose;
+  }
+
+  // 現在スキャンのn個の点を、findBlock(i0, i1, cur, ref)で対応づけてcurLpsとrefLpsに入れる。
+  // findBlockは点[i0, i1)の対応をcurとrefの末尾に追加する。
+  // 並列のときは点を連続したブロックに分け、各ブロックの結果を別の配列に入れてからブロックの順につなぐ。
+  // そのため、結果の順序はスレッド数によらず逐次の場合と同じになる。
+  template <class F>
+  void associateBlocks(size_t n, F findBlock) {
+    const size_t MIN_BLOCK = 64;                 // ブロックの最小点数。小さすぎると並列化の手間のほうが大きい
+    curLps.clear();
+    refLps.clear();
+
+    size_t tn = workers.getThreadNum();
+    size_t bn = std::min(4*tn, n/MIN_BLOCK);     // ブロック数。負荷がばらつくので、スレッド数より多めに分ける
+    if (tn <= 1 || bn <= 1) {
+      findBlock(0, n, curLps, refLps);
+      return;
+    }
+
+    if (blockCurLps.size() < bn) {
+      blockCurLps.resize(bn);
+      blockRefLps.resize(bn);
+    }
+    workers.run(bn, [&](size_t b) {
+      std::vector<const LPoint2D*> &cur = blockCurLps[b];
+      std::vector<const LPoint2D*> &ref = blockRefLps[b];
+      cur.clear();
+      ref.clear();
+      findBlock(n*b/bn, n*(b+1)/bn, cur, ref);
+    });
+
+    for (size_t b=0; b<bn; b++) {                // ブロックの順につなぐ
+      curLps.insert(curLps.end(), blockCurLps[b].begin(), blockCurLps[b].end());
+      refLps.insert(refLps.end(), blockRefLps[b].begin(), blockRefLps[b].end());
+    }
+  }
 };
 
 #endif
@@ -0,0 +1,163 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file DistanceField2D.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include "DistanceField2D.h"
+
+using namespace std;
+
+/////////
+
+// 点群lpsから距離場を作り直す
+void DistanceField2D::build(const vector<LPoint2D> &lps) {
+  clear();
+  addPoints(lps);
+}
+
+// 点群lpsを距離場に追加する。領域が足りなければ広げる
+void DistanceField2D::addPoints(const vector<LPoint2D> &lps) {
+  if (lps.empty())
+    return;
+
+  // 点群の範囲に、距離を入れる範囲と補間用の1格子点を加えた領域が必要
+  int r = static_cast<int>(ceil(maxDist/csize));
+  int xa = cellIndex(lps[0].x), xb = xa;
+  int ya = cellIndex(lps[0].y), yb = ya;
+  for (size_t i=1; i<lps.size(); i++) {
+    int xi = cellIndex(lps[i].x);
+    int yi = cellIndex(lps[i].y);
+    xa = min(xa, xi);
+    xb = max(xb, xi);
+    ya = min(ya, yi);
+    yb = max(yb, yi);
+  }
+  xa -= r;
+  ya -= r;
+  xb += r + 1;
+  yb += r + 1;
+  if (nx == 0 || xa < xmin || ya < ymin || xb >= xmin+nx || yb >= ymin+ny)
+    expand(xa, ya, xb, yb);
+
+  for (size_t i=0; i<lps.size(); i++)
+    addPoint(lps[i]);
+  pointNum += lps.size();
+}
+
+// 格子点の範囲[xa, xb]x[ya, yb]が入るように領域を広げる。
+// 広げる方向には余分にMARGIN_CELL_NUMだけとって、次に広げるまでの回数を減らす
+void DistanceField2D::expand(int xa, int ya, int xb, int yb) {
+  int x0, y0, x1, y1;                 // 新しい領域の左下と右上の格子点
+  if (nx == 0) {
+    x0 = xa - MARGIN_CELL_NUM;
+    y0 = ya - MARGIN_CELL_NUM;
+    x1 = xb + MARGIN_CELL_NUM;
+    y1 = yb + MARGIN_CELL_NUM;
+  }
+  else {
+    x0 = (xa < xmin) ? xa - MARGIN_CELL_NUM : xmin;
+    y0 = (ya < ymin) ? ya - MARGIN_CELL_NUM : ymin;
+    x1 = (xb >= xmin+nx) ? xb + MARGIN_CELL_NUM : xmin+nx-1;
+    y1 = (yb >= ymin+ny) ? yb + MARGIN_CELL_NUM : ymin+ny-1;
+  }
+
+  int nx2 = x1 - x0 + 1;
+  int ny2 = y1 - y0 + 1;
+  vector<float> edists2(static_cast<size_t>(nx2)*ny2, static_cast<float>(maxDist));
+  vector<float> sdists2(static_cast<size_t>(nx2)*ny2, 0);
+  for (int yi=0; yi<ny; yi++) {       // これまでの値を新しい領域に移す
+    size_t k = static_cast<size_t>(yi)*nx;
+    size_t k2 = static_cast<size_t>(yi + ymin - y0)*nx2 + (xmin - x0);
+    copy(edists.begin()+k, edists.begin()+k+nx, edists2.begin()+k2);
+    copy(sdists.begin()+k, sdists.begin()+k+nx, sdists2.begin()+k2);
+  }
+
+  edists.swap(edists2);
+  sdists.swap(sdists2);
+  xmin = x0;
+  ymin = y0;
+  nx = nx2;
+  ny = ny2;
+}
+
+// 点lpからmaxDist以内の格子点について、lpがこれまでの点より近ければ、lpの垂直距離に置き換える
+void DistanceField2D::addPoint(const LPoint2D &lp) {
+  int r = static_cast<int>(ceil(maxDist/csize));
+  int cx = cellIndex(lp.x);
+  int cy = cellIndex(lp.y);
+  double md2 = maxDist*maxDist;
+  for (int yi=cy-r; yi<=cy+r+1; yi++) {
+    double dy = yi*csize - lp.y;
+    size_t k0 = static_cast<size_t>(yi - ymin)*nx;
+    for (int xi=cx-r; xi<=cx+r+1; xi++) {
+      double dx = xi*csize - lp.x;
+      double d2 = dx*dx + dy*dy;
+      if (d2 >= md2)
+        continue;
+      size_t k = k0 + (xi - xmin);
+      double e = edists[k];
+      if (d2 < e*e) {                 // これまでの点より近い
+        edists[k] = static_cast<float>(sqrt(d2));
+        sdists[k] = static_cast<float>(lp.nx*dx + lp.ny*dy);    // 法線方向の距離
+      }
+    }
+  }
+}
+
+////////
+
+// 位置(x, y)の符号つき距離dと、その勾配(gx, gy)を双線形補間で求める。
+// 周囲4格子点のどれかが無効（maxDistより遠い）なら、falseを返す
+bool DistanceField2D::interpolate(double x, double y, double &d, double &gx, double &gy) const {
+  double fx = x/csize - xmin;
+  double fy = y/csize - ymin;
+  if (!(fx >= 0 && fy >= 0 && fx < nx-1 && fy < ny-1))       // 領域外。NaNもここで除く
+    return(false);
+
+  int xi = static_cast<int>(fx);
+  int yi = static_cast<int>(fy);
+  size_t k = static_cast<size_t>(yi)*nx + xi;
+  float fmax = static_cast<float>(maxDist);
+  if (edists[k] >= fmax || edists[k+1] >= fmax || edists[k+nx] >= fmax || edists[k+nx+1] >= fmax)
+    return(false);
+
+  double a = fx - xi;
+  double b = fy - yi;
+  double d00 = sdists[k];
+  double d10 = sdists[k+1];
+  double d01 = sdists[k+nx];
+  double d11 = sdists[k+nx+1];
+  d = (1-b)*((1-a)*d00 + a*d10) + b*((1-a)*d01 + a*d11);
+  gx = ((1-b)*(d10 - d00) + b*(d11 - d01))/csize;            // 補間式をxで微分
+  gy = ((1-a)*(d01 - d00) + a*(d11 - d10))/csize;            // 補間式をyで微分
+
+  return(true);
+}
+
+// 点群lpsをposeで座標変換し、距離がdthre以内の点の数をnumに入れて、それらの距離の2乗の平均を返す
+double DistanceField2D::evaluate(const vector<LPoint2D> &lps, const Pose2D &pose, double dthre, size_t &num) const {
+  const double (*R)[2] = pose.Rmat;
+  double err = 0;
+  num = 0;
+  for (size_t i=0; i<lps.size(); i++) {
+    const LPoint2D &lp = lps[i];
+    double x = R[0][0]*lp.x + R[0][1]*lp.y + pose.tx;
+    double y = R[1][0]*lp.x + R[1][1]*lp.y + pose.ty;
+    double d, gx, gy;
+    if (!interpolate(x, y, d, gx, gy) || abs(d) > dthre)
+      continue;
+    err += d*d;
+    ++num;
+  }
+
+  return(num > 0 ? err/num : HUGE_VAL);
+}
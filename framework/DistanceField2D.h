@@ -0,0 +1,91 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file DistanceField2D.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef DISTANCE_FIELD2D_H_
+#define DISTANCE_FIELD2D_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "LPoint2D.h"
+#include "Pose2D.h"
+
+///////
+
+// 地図点までの符号つき距離を格子点ごとに保存した距離場。
+// 各格子点には、maxDist以内で最も近い地図点を選び、その点の法線方向の距離（垂直距離）を入れる。
+// 点を追加するときは、その点からmaxDist以内の格子点だけを更新するので、地図の成長に合わせて少しずつ作れる。
+// 任意の位置の距離は周囲4格子点の双線形補間で求め、その勾配も補間式から解析的に求める。
+// スキャンマッチングで、データ対応づけをせずに垂直距離を直接最小化するために使う。
+class DistanceField2D
+{
+private:
+  static const int MARGIN_CELL_NUM = 100;     // 領域を広げるときに余分にとるセル数
+
+  double csize;                       // 格子間隔[m]
+  double maxDist;                     // 距離を入れる範囲[m]。これより遠い格子点は無効
+  int xmin, ymin;                     // 左下の格子点の位置
+  int nx, ny;                         // 横と縦の格子点数
+  std::vector<float> edists;          // 各格子点から最も近い地図点までのユークリッド距離。yi、xiの順
+  std::vector<float> sdists;          // 各格子点の符号つき垂直距離。yi、xiの順
+  size_t pointNum;                    // 登録した点数
+
+public:
+  DistanceField2D() : csize(0.05), maxDist(0.5), xmin(0), ymin(0), nx(0), ny(0), pointNum(0) {
+  }
+
+  ~DistanceField2D() {
+  }
+
+  // 格子間隔と距離の範囲は、buildの前に設定する
+  void setCellSize(double c) {
+    csize = c;
+  }
+
+  void setMaxDist(double d) {
+    maxDist = d;
+  }
+
+  double getMaxDist() const {
+    return(maxDist);
+  }
+
+  size_t getPointNum() const {
+    return(pointNum);
+  }
+
+  void clear() {
+    nx = ny = 0;
+    edists.clear();
+    sdists.clear();
+    pointNum = 0;
+  }
+
+///////
+
+  void build(const std::vector<LPoint2D> &lps);
+  void addPoints(const std::vector<LPoint2D> &lps);
+  bool interpolate(double x, double y, double &d, double &gx, double &gy) const;
+  double evaluate(const std::vector<LPoint2D> &lps, const Pose2D &pose, double dthre, size_t &num) const;
+
+private:
+  // 位置[m]から格子点の位置を求める。負の位置でも切り下げにする
+  int cellIndex(double v) const {
+    return(static_cast<int>(floor(v/csize)));
+  }
+
+  void expand(int xa, int ya, int xb, int yb);
+  void addPoint(const LPoint2D &lp);
+};
+
+#endif
@@ -94,6 +94,16 @@ public:
 
   virtual bool detectLoop(Scan2D *curScan, Pose2D &curPose, int cnt);
 
+  // 以下は、ループ検出を別スレッドで行うときに使う。
+  // フロントエンドと共有している部品（データ対応づけ器など）を複製に替えて、このクラス専用にする
+  virtual void detachComponents() {
+  }
+
+  // ループ検出に使う地図の写しをとる。フロントエンドのスレッドで、ループ検出していないときに呼ぶ。
+  // 以後のdetectLoopは、フロントエンドが地図を更新しても、この写しを使う
+  virtual void takeSnapshot() {
+  }
+
 };
 
 #endif
@@ -1,4 +1,4 @@
-/*******************************************************************
+﻿/*******************************************************************
  * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
  *                    Chiba Institute of Technology.
  *                    All rights reserved.
@@ -18,3 +18,83 @@
 
 using namespace std;
 using namespace nanoflann;
+
+////////////
+
+// 点群refLpsの索引を用意する。キャッシュに同じ点群の索引があればそれを使い、
+// なければ最も長く使っていない索引を捨てて作る。
+void NNFinder2D::makeIndex(const vector<const LPoint2D*> &refLps) {
+  ++useCnt;
+  IndexCache *slot = nullptr;
+  for (int i=0; i<CACHE_NUM; i++) {
+    IndexCache &c = caches[i];
+    if (c.index != nullptr && c.fmap.samePoints(refLps)) {      // 作り直さなくてよい
+      slot = &c;
+      break;
+    }
+    if (slot == nullptr || c.lastUse < slot->lastUse)            // 追い出し候補
+      slot = &c;
+  }
+
+  if (slot->index == nullptr || !slot->fmap.samePoints(refLps)) {
+    slot->fmap.setPoints(refLps);                // 座標を連続した配列にコピー
+
+    // 大きい点群は複数スレッドで作る。0はCPUのスレッド数を使う。
+    // スレッド数が同じなら索引のオブジェクトを使い回して、buildIndexで作り直す。
+    // 番号の配列の領域はそのまま使われるが、木の節点はnanoflannが作り直すたびにmallocする
+    unsigned int threadNum = (refLps.size() >= parallelThre) ? 0 : 1;
+    if (slot->index != nullptr && slot->threadNum == threadNum)
+      slot->index->buildIndex();
+    else {
+      delete slot->index;                        // 索引はコンストラクタで作られるので、buildIndexは呼ばない
+      slot->index = new my_kd_tree_t(2, slot->fmap, KDTreeSingleIndexAdaptorParams(10, KDTreeSingleIndexAdaptorFlags::None, threadNum));
+      slot->threadNum = threadNum;
+    }
+    ++buildNum;
+  }
+
+  slot->lastUse = useCnt;
+  fmap = &(slot->fmap);
+  index = slot->index;
+}
+
+// キャッシュした索引をすべて捨てる
+void NNFinder2D::deleteIndex() {
+  for (int i=0; i<CACHE_NUM; i++) {
+    delete caches[i].index;
+    caches[i].index = nullptr;
+  }
+  fmap = nullptr;
+  index = nullptr;
+}
+
+// 索引キャッシュの使用状況を表示する（確認用）
+void NNFinder2D::printStats() {
+  printf("NNFinder2D: makeIndex=%zu, build=%zu, reused=%zu\n", useCnt, buildNum, useCnt-buildNum);
+}
+
+////////////
+
+// curScanの点[i0, i1)について、predPoseで座標変換した位置から距離dthre以内で最も近い点を見つける。
+// 見つかった点の組をcurLpsとrefLpsの末尾に追加し、組の数を返す。複数スレッドから同時に呼んでよい。
+// curLpsとrefLpsは呼び出し側で使い回すので、容量が足りていればメモリ確保は起きない
+size_t NNFinder2D::getNearestNeighbors(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, double dthre, vector<const LPoint2D*> &curLps, vector<const LPoint2D*> &refLps) const {
+  const vector<LPoint2D> &lps = curScan->lps;
+  const vector<const LPoint2D*> &flps = fmap->lps;
+  const double (*R)[2] = predPose.Rmat;
+  size_t num=0;
+  for (size_t i=i0; i<i1; i++) {
+    const LPoint2D &clp = lps[i];
+    double query[2];                                                 // clpの予測位置
+    query[0] = R[0][0]*clp.x + R[0][1]*clp.y + predPose.tx;
+    query[1] = R[1][0]*clp.x + R[1][1]*clp.y + predPose.ty;
+
+    int idx = findNearest(query, dthre);
+    if (idx >= 0) {
+      curLps.push_back(&clp);
+      refLps.push_back(flps[idx]);
+      ++num;
+    }
+  }
+  return(num);
+}
@@ -1,4 +1,4 @@
-/*******************************************************************
+﻿/*******************************************************************
  * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
  *                    Chiba Institute of Technology.
  *                    All rights reserved.
@@ -21,6 +21,8 @@
 #include <nanoflann.hpp>
 #include "MyUtil.h"
 #include "LPoint2D.h"
+#include "Pose2D.h"
+#include "Scan2D.h"
 
 //////////////////////
 
@@ -61,67 +63,154 @@ public:
 
 /////////////////////
 
+// 座標を連続した配列にコピーして持つ。
+// 探索中の距離計算はこの配列だけを読むので、元の点を指すポインタはたどらない。
+// 元の点へは、同じ番号のlpsで戻る。
+class NanoFlannIFc2D
+{
+public:
+  std::vector<double> xys;                 // 点の座標。x0, y0, x1, y1, ...の順
+  std::vector<const LPoint2D*> lps;        // 各番号の元の点
+  double bmin[2], bmax[2];                 // 点群を囲む矩形
+
+  NanoFlannIFc2D() {
+    bmin[0] = bmin[1] = bmax[0] = bmax[1] = 0;
+  }
+
+  ~NanoFlannIFc2D() {
+  }
+
+  // 点群refLpsの座標をコピーし、囲む矩形を求める
+  void setPoints(const std::vector<const LPoint2D*> &refLps) {
+    size_t n = refLps.size();
+    if (n > lps.capacity())                // 点数が少し増えるたびに確保し直さないように、余裕をもって広げる
+      lps.reserve(n + n/2);
+    lps.assign(refLps.begin(), refLps.end());
+    xys.resize(2*n);
+    bmin[0] = bmin[1] = 0;
+    bmax[0] = bmax[1] = 0;
+    for (size_t i=0; i<n; i++) {
+      double x = refLps[i]->x;
+      double y = refLps[i]->y;
+      xys[2*i] = x;
+      xys[2*i+1] = y;
+      if (i == 0 || x < bmin[0]) bmin[0] = x;
+      if (i == 0 || x > bmax[0]) bmax[0] = x;
+      if (i == 0 || y < bmin[1]) bmin[1] = y;
+      if (i == 0 || y > bmax[1]) bmax[1] = y;
+    }
+  }
+
+  // 点群refLpsが、setPointsした時と同じ点で座標も変わっていないか
+  bool samePoints(const std::vector<const LPoint2D*> &refLps) const {
+    if (refLps.size() != lps.size())
+      return(false);
+    for (size_t i=0; i<lps.size(); i++) {
+      if (refLps[i] != lps[i] || refLps[i]->x != xys[2*i] || refLps[i]->y != xys[2*i+1])
+        return(false);
+    }
+    return(true);
+  }
+
+///////
+
+  size_t kdtree_get_point_count() const { 
+    return lps.size(); 
+  }
+
+  double kdtree_get_pt(const size_t idx, int dim) const	{
+    return xys[2*idx + dim];
+  }
+
+  template <class BBOX>
+  bool kdtree_get_bbox(BBOX &bb) const {
+    bb[0].low = bmin[0];
+    bb[0].high = bmax[0];
+    bb[1].low = bmin[1];
+    bb[1].high = bmax[1];
+    return true;
+  }
+};
+
+/////////////////////
+
+// 参照点群の索引は、点群ごとにCACHE_NUM個までキャッシュしておく。
+// 同じ点群（同じ点で座標も同じ）が再び来たら、索引を作り直さずにそれを使う。
 class NNFinder2D
 {
 public:
-  NanoFlannIFp2D *fmap;
+  typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, NanoFlannIFc2D>, NanoFlannIFc2D, 2> my_kd_tree_t;
+
+  NanoFlannIFc2D *fmap;                   // 現在使っている索引の点群
+  my_kd_tree_t *index;                    // 現在使っている索引
+
+private:
+  static const int CACHE_NUM = 4;         // キャッシュする索引の数
+
+  struct IndexCache
+  {
+    NanoFlannIFc2D fmap;                  // 索引を作った点群
+    my_kd_tree_t *index;                  // 索引。なければnullptr
+    unsigned int threadNum;               // 索引を作るスレッド数。索引のオブジェクトに固定される
+    size_t lastUse;                       // 最後に使った時刻。追い出しに使う
+
+    IndexCache() : index(nullptr), threadNum(1), lastUse(0) {
+    }
+  };
 
-  typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, NanoFlannIFp2D>, NanoFlannIFp2D, 2> my_kd_tree_t;
-  my_kd_tree_t *index;
+  IndexCache caches[CACHE_NUM];
+  size_t useCnt;                          // makeIndexの呼び出し回数
+  size_t buildNum;                        // 索引を作った回数
+  size_t parallelThre;                    // この点数以上の点群は、索引を並列に作る
 
 public:
-  NNFinder2D() : index(nullptr) {
-    fmap = new NanoFlannIFp2D();
+  NNFinder2D() : fmap(nullptr), index(nullptr), useCnt(0), buildNum(0), parallelThre(20000) {
   }
 
-  NNFinder2D(int pmn) : index(nullptr) {
-    fmap = new NanoFlannIFp2D();
+  NNFinder2D(int pmn) : fmap(nullptr), index(nullptr), useCnt(0), buildNum(0), parallelThre(20000) {
   }
 
   ~NNFinder2D() {
-    delete fmap;
-    if (index != nullptr)
-      delete index;
+    deleteIndex();
+  }
+
+  void setParallelThre(size_t n) {
+    parallelThre = n;
   }
 
 ///////////
   
-  void makeIndex(const std::vector<const LPoint2D*> &refLps) {
-    deleteIndex();
-    std::vector<const LPoint2D*> &flps = fmap->lps;
-    flps.clear();
-    flps.resize(refLps.size());
-    for (size_t i=0; i<refLps.size(); i++) {
-      flps[i] = refLps[i];
-    }
+  void makeIndex(const std::vector<const LPoint2D*> &refLps);
+  void deleteIndex();
+  void printStats();
 
-    index = new my_kd_tree_t(2, *fmap, nanoflann::KDTreeSingleIndexAdaptorParams(10));
-    index->buildIndex();
+  // clpから距離dthre以内で最も近い点を返す。なければnullptr
+  const LPoint2D *getNearestNeighbor(const LPoint2D *clp, const std::vector<const LPoint2D*> &lps, double dthre) {
+    double query[2] = {clp->x, clp->y};
+    int idx = findNearest(query, dthre);
+    if (idx < 0)
+      return(nullptr);
+    return(lps[idx]);
   }
 
-  void deleteIndex() {
-    if (index != nullptr) {
-      delete index;
-      index = nullptr;
-    }
+  size_t getNearestNeighbors(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, double dthre, std::vector<const LPoint2D*> &curLps, std::vector<const LPoint2D*> &refLps) const;
+
+  size_t getNearestNeighbors(const Scan2D *curScan, const Pose2D &predPose, double dthre, std::vector<const LPoint2D*> &curLps, std::vector<const LPoint2D*> &refLps) const {
+    return(getNearestNeighbors(curScan, 0, curScan->lps.size(), predPose, dthre, curLps, refLps));
   }
 
-  const LPoint2D *getNearestNeighbor(const LPoint2D *clp, const std::vector<const LPoint2D*> &lps, double dthre) {
-    double query[2] = {static_cast<double>(clp->x), static_cast<double>(clp->y)};
-    size_t num_results = 1;
-    std::vector<uint32_t> ret_index(num_results);
-    std::vector<double> out_dist_sqr(num_results);
-    index->knnSearch(query, num_results, &ret_index[0], &out_dist_sqr[0]);
-
-    if (!ret_index.empty()) {
-      double d = out_dist_sqr[0];            // 二乗距離
-      if (d <= dthre*dthre) {
-        size_t idx = ret_index[0];
-        const LPoint2D *lp = lps[idx];
-        return(lp);
-      }
-    }
-    return(nullptr);
+private:
+  // queryから距離dthre以内で最も近い点の番号を返す。なければ-1。
+  // 結果セットは1点分の変数に直接書き込むので、探索中にメモリ確保はしない
+  int findNearest(const double query[2], double dthre) const {
+    uint32_t idx = 0;
+    double dist = 0;
+    nanoflann::RKNNResultSet<double, uint32_t> rset(1, dthre*dthre);     // dthreより遠い点は枝刈りされる
+    rset.init(&idx, &dist);
+    index->findNeighbors(rset, query);
+    if (rset.empty())
+      return(-1);
+    return(static_cast<int>(idx));
   }
 };
 
@@ -0,0 +1,171 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file NNGridFrozen.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <algorithm>
+#include "NNGridFrozen.h"
+
+using namespace std;
+
+////////////
+
+// 点群lpsから格子テーブルを作る。csはセルサイズ[m]
+void NNGridFrozen::build(const vector<LPoint2D> &lps, double cs) {
+  base = lps.empty() ? nullptr : &lps[0];
+  csize = cs;
+  xs.clear();
+  ys.clear();
+  ids.clear();
+  if (lps.empty()) {
+    nx = ny = 0;
+    offsets.assign(1, 0);
+    return;
+  }
+
+  // 点群の範囲を求める
+  double bxmin=lps[0].x, bxmax=lps[0].x;
+  double bymin=lps[0].y, bymax=lps[0].y;
+  for (size_t i=1; i<lps.size(); i++) {
+    bxmin = min(bxmin, lps[i].x);
+    bxmax = max(bxmax, lps[i].x);
+    bymin = min(bymin, lps[i].y);
+    bymax = max(bymax, lps[i].y);
+  }
+
+  // 範囲を覆うセルを決める。セル数が多すぎるときはセルを大きくする
+  while (true) {
+    xmin = cellIndex(bxmin);
+    ymin = cellIndex(bymin);
+    nx = cellIndex(bxmax) - xmin + 1;
+    ny = cellIndex(bymax) - ymin + 1;
+    if (static_cast<size_t>(nx)*ny <= MAX_CELL_NUM)
+      break;
+    csize *= 2;
+  }
+
+  // セルごとの点数を数えて、先頭位置を決める。作業領域は前回のものを使い回す
+  size_t n = lps.size();
+  cells.resize(n);                            // 各点のセル番号
+  offsets.assign(nx*ny+1, 0);
+  for (size_t i=0; i<n; i++) {
+    int c = (cellIndex(lps[i].y) - ymin)*nx + (cellIndex(lps[i].x) - xmin);
+    cells[i] = c;
+    ++offsets[c+1];
+  }
+  for (int c=0; c<nx*ny; c++)
+    offsets[c+1] += offsets[c];
+
+  // 点をセルの順に詰める。セル内は元の番号の順
+  xs.resize(n);
+  ys.resize(n);
+  ids.resize(n);
+  pos.assign(offsets.begin(), offsets.end()-1);           // 各セルの次の書き込み位置
+  for (size_t i=0; i<n; i++) {
+    int k = pos[cells[i]]++;
+    xs[k] = lps[i].x;
+    ys[k] = lps[i].y;
+    ids[k] = static_cast<int>(i);
+  }
+}
+
+///////////
+
+// スキャン点clpをpredPoseで座標変換した位置から、距離dthre以内で最も近い点を見つける
+const LPoint2D *NNGridFrozen::findClosestPoint(const LPoint2D *clp, const Pose2D &predPose, double dthre) const {
+  LPoint2D glp;                           // clpの予測位置
+  predPose.globalPoint(*clp, glp);         // predPoseで座標変換
+
+  int k = searchNearest(glp.x, glp.y, dthre);
+  if (k < 0)
+    return(nullptr);
+  return(&base[ids[k]]);
+}
+
+// curScanの点[i0, i1)について、predPoseで座標変換した位置から距離dthre以内で最も近い点を見つける。
+// 見つかった点の組をcurLpsとrefLpsの末尾に追加し、組の数を返す。複数スレッドから同時に呼んでよい
+size_t NNGridFrozen::findClosestPoints(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, double dthre, vector<const LPoint2D*> &curLps, vector<const LPoint2D*> &refLps) const {
+  const vector<LPoint2D> &lps = curScan->lps;
+  const double (*R)[2] = predPose.Rmat;
+  size_t num=0;
+  for (size_t i=i0; i<i1; i++) {
+    const LPoint2D &clp = lps[i];
+    double gx = R[0][0]*clp.x + R[0][1]*clp.y + predPose.tx;      // clpの予測位置
+    double gy = R[1][0]*clp.x + R[1][1]*clp.y + predPose.ty;
+
+    int k = searchNearest(gx, gy, dthre);
+    if (k >= 0) {
+      curLps.push_back(&clp);
+      refLps.push_back(&base[ids[k]]);
+      ++num;
+    }
+  }
+  return(num);
+}
+
+// 位置(gx, gy)から距離dthre以内で最も近い点を探し、詰めた配列での位置を返す。なければ-1
+int NNGridFrozen::searchNearest(double gx, double gy, double dthre) const {
+  if (ids.empty())
+    return(-1);
+
+  int cxi = cellIndex(gx);                // 予測位置のセル
+  int cyi = cellIndex(gy);
+  double fx = gx - cxi*csize;             // セル内での位置
+  double fy = gy - cyi*csize;
+  double edge = min(min(fx, csize-fx), min(fy, csize-fy));   // 予測位置のセルの境界までの距離
+  int cx = cxi - xmin;                    // テーブル内でのセル位置。テーブルの外のこともある
+  int cy = cyi - ymin;
+  int rmax = static_cast<int>(ceil(dthre/csize));            // dthre内を覆うリング
+
+  double dmin = dthre*dthre;
+  int kmin = -1;
+  for (int r=0; r<=rmax; r++) {
+    // 中心からr番目のリング。上下の行はまとめて、左右の列はセルごとに調べる
+    searchRow(cy-r, cx-r, cx+r, gx, gy, dmin, kmin);
+    if (r > 0) {
+      searchRow(cy+r, cx-r, cx+r, gx, gy, dmin, kmin);
+      for (int yi=cy-r+1; yi<=cy+r-1; yi++) {
+        searchRow(yi, cx-r, cx-r, gx, gy, dmin, kmin);
+        searchRow(yi, cx+r, cx+r, gx, gy, dmin, kmin);
+      }
+    }
+
+    // まだ調べていない点までの距離はbound以上なので、それより近い点が見つかっていれば終わり
+    double bound = r*csize + edge;
+    if (bound >= dthre || (kmin >= 0 && dmin < bound*bound))
+      break;
+  }
+
+  return(kmin);
+}
+
+// 行yiのセルxaからxbまでの点を調べ、dminより近い点があればdminとkminを更新する
+void NNGridFrozen::searchRow(int yi, int xa, int xb, double gx, double gy, double &dmin, int &kmin) const {
+  if (yi < 0 || yi >= ny)                 // テーブルの外
+    return;
+  xa = max(xa, 0);
+  xb = min(xb, nx-1);
+  if (xa > xb)
+    return;
+
+  int kb = offsets[yi*nx + xa];           // 1行分のセルの点は連続している
+  int ke = offsets[yi*nx + xb + 1];
+  for (int k=kb; k<ke; k++) {
+    double dx = xs[k] - gx;
+    double dy = ys[k] - gy;
+    double d = dx*dx + dy*dy;
+    if (d <= dmin && (kmin < 0 || d < dmin)) {    // dthre内で距離が最小となる点を保存
+      dmin = d;
+      kmin = k;
+    }
+  }
+}
@@ -0,0 +1,78 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file NNGridFrozen.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef _NN_GRID_FROZEN_H_
+#define _NN_GRID_FROZEN_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "Pose2D.h"
+#include "Scan2D.h"
+
+///////
+
+// 参照スキャン用の固定した格子テーブル。
+// 参照スキャンごとに1回作り、その後は点の追加をしない。
+// 点の座標と元の番号を、セルの順（yi、xiの順）に並べた連続配列に詰め、
+// セルごとに先頭位置offsetsをもつ（CSR形式）。
+// 同じ行の隣り合うセルの点は配列上でも連続するので、探索範囲の1行分を1回のループで調べられる。
+// 探索は予測位置のセルから外側のリングへ広げ、見つけた点より近い点が残りのリングにありえなくなったら打ち切る。
+class NNGridFrozen
+{
+private:
+  static const size_t MAX_CELL_NUM = 4000000;  // セル数の上限。超えるときはセルを大きくする
+
+  double csize;                       // セルサイズ[m]
+  int xmin, ymin;                     // 左下のセルの位置
+  int nx, ny;                         // 横と縦のセル数
+  std::vector<int> offsets;           // 各セルの点の先頭位置。要素数はnx*ny+1
+  std::vector<double> xs;             // 点のx座標。セルの順
+  std::vector<double> ys;             // 点のy座標。セルの順
+  std::vector<int> ids;               // 点の元の番号。セルの順
+  std::vector<int> cells;             // 各点のセル番号。build用の作業領域
+  std::vector<int> pos;               // 各セルの次の書き込み位置。build用の作業領域
+  const LPoint2D *base;               // 元の点群の先頭
+
+public:
+  NNGridFrozen() : csize(0.2), xmin(0), ymin(0), nx(0), ny(0), base(nullptr) {
+  }
+
+  ~NNGridFrozen() {
+  }
+
+  size_t size() const {
+    return(ids.size());
+  }
+
+////////////
+
+  void build(const std::vector<LPoint2D> &lps, double cs);
+  const LPoint2D *findClosestPoint(const LPoint2D *clp, const Pose2D &predPose, double dthre) const;
+  size_t findClosestPoints(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, double dthre, std::vector<const LPoint2D*> &curLps, std::vector<const LPoint2D*> &refLps) const;
+
+  size_t findClosestPoints(const Scan2D *curScan, const Pose2D &predPose, double dthre, std::vector<const LPoint2D*> &curLps, std::vector<const LPoint2D*> &refLps) const {
+    return(findClosestPoints(curScan, 0, curScan->lps.size(), predPose, dthre, curLps, refLps));
+  }
+
+private:
+  // 位置[m]からセルの位置を求める。負の位置でも切り下げにする
+  int cellIndex(double v) const {
+    return(static_cast<int>(floor(v/csize)));
+  }
+
+  int searchNearest(double gx, double gy, double dthre) const;
+  void searchRow(int yi, int xa, int xb, double gx, double gy, double &dmin, int &kmin) const;
+};
+
+#endif
@@ -12,6 +12,7 @@
  * @author Masahiro Tomono
  ****************************************************************************/
 
+#include <algorithm>
 #include "NNGridTable.h"
 
 using namespace std;
@@ -20,16 +21,46 @@ using namespace std;
 
 // 格子テーブルにスキャン点lpを登録する
 void NNGridTable::addPoint(const LPoint2D *lp) {
-  // テーブル検索のインデックス計算。まず、対象領域内にあるかチェックする。
-  int xi = static_cast<int>(lp->x/csize) + tsize;
-  if (xi < 0 || xi > 2*tsize)                      // 対象領域の外
-    return;
-  int yi = static_cast<int>(lp->y/csize) + tsize;
-  if (yi < 0 || yi > 2*tsize)                      // 対象領域の外
-    return;
-
-  size_t idx = static_cast<size_t>(yi*(2*tsize +1) + xi);   // テーブルのインデックス
-  table[idx].lps.push_back(lp);                             // 目的のセルに入れる
+  int xi = cellIndex(lp->x);                                // セル位置
+  int yi = cellIndex(lp->y);
+  NNGridCell &cell = getCell(xi, yi);
+  if (cell.num == 0)                                        // 初めて点が入るセル
+    newCells.push_back(CellRef(cellKey(xi, yi), &cell));
+  if (!cell.dirty) {                                        // 代表点を作り直す対象にする
+    cell.dirty = true;
+    dirtyCells.push_back(&cell);
+  }
+
+  int k = static_cast<int>(pts.size());                    // 目的のセルのリストの末尾につなぐ
+  pts.push_back(lp);
+  nexts.push_back(-1);
+  if (cell.tail < 0)
+    cell.head = k;
+  else
+    nexts[cell.tail] = k;
+  cell.tail = k;
+  ++cell.num;
+}
+
+// タイル位置(ti, tj)のタイルを返す。まだなければnullptr
+vector<NNGridCell> *NNGridTable::findTile(int ti, int tj) {
+  auto it = tiles.find(cellKey(ti, tj));
+  if (it == tiles.end())
+    return(nullptr);
+  return(&(it->second));
+}
+
+// セル位置(xi, yi)のセルを返す。タイルがなければ作る
+NNGridCell &NNGridTable::getCell(int xi, int yi) {
+  int64_t key = cellKey(tileIndex(xi), tileIndex(yi));
+  if (lastTile == nullptr || key != lastTileKey) {          // 前回と違うタイルのときだけハッシュ表を引く
+    vector<NNGridCell> &tile = tiles[key];
+    if (tile.empty())
+      tile.resize(TILE_SIZE*TILE_SIZE);                     // 新しいタイルの領域確保
+    lastTileKey = key;
+    lastTile = &tile;
+  }
+  return((*lastTile)[tileOffset(xi, yi)]);
 }
 
 ///////////
@@ -39,13 +70,8 @@ const LPoint2D *NNGridTable::findClosestPoint(const LPoint2D *clp, const Pose2D
   LPoint2D glp;                           // clpの予測位置
   predPose.globalPoint(*clp, glp);         // relPoseで座標変換
 
-  // clpのテーブルインデックス。対象領域内にあるかチェックする。
-  int cxi = static_cast<int>(glp.x/csize) + tsize;
-  if (cxi < 0 || cxi > 2*tsize)
-    return(nullptr);
-  int cyi = static_cast<int>(glp.y/csize) + tsize;
-  if (cyi < 0 || cyi > 2*tsize)
-    return(nullptr);
+  int cxi = cellIndex(glp.x);             // clpのセル位置
+  int cyi = cellIndex(glp.y);
 
   size_t pn=0;                            // 探したセル内の点の総数。確認用
   double dmin=1000000;
@@ -54,21 +80,35 @@ const LPoint2D *NNGridTable::findClosestPoint(const LPoint2D *clp, const Pose2D
 
 //  printf("R=%d\n", R);
 
+  // 探索範囲にかかるタイルを、タイルの行ごとにまとめて引いておく
+  const static int MAX_ROW_TILES = 8;
+  vector<NNGridCell> *rowTiles[MAX_ROW_TILES];
+  int ti0 = tileIndex(cxi-R);
+  int tn = tileIndex(cxi+R) - ti0 + 1;    // 1行にかかるタイル数
+  bool useRow = (tn <= MAX_ROW_TILES);    // 範囲が広すぎるときはセルごとに引く
+  int curTj = 0;
+  bool rowValid = false;
+
   // ±R四方を探す
   for (int i=-R; i<=R; i++) {
     int yi = cyi+i;                       // cyiから広げる
-    if (yi < 0 || yi > 2*tsize)
-      continue;
+    int tj = tileIndex(yi);
+    if (useRow && (!rowValid || tj != curTj)) {     // タイルの行が替わったときだけハッシュ表を引く
+      for (int k=0; k<tn; k++)
+        rowTiles[k] = findTile(ti0+k, tj);
+      curTj = tj;
+      rowValid = true;
+    }
     for (int j=-R; j<=R; j++) {
       int xi = cxi+j;                     // cxiから広げる
-      if (xi < 0 || xi > 2*tsize)
+      int ti = tileIndex(xi);
+      vector<NNGridCell> *tile = useRow ? rowTiles[ti-ti0] : findTile(ti, tj);
+      if (tile == nullptr)                          // 点のないタイル
         continue;
 
-      size_t idx = yi*(2*tsize+1) + xi;             // テーブルインデックス
-      NNGridCell &cell = table[idx];                // そのセル
-      vector<const LPoint2D*> &lps = cell.lps;      // セルがもつスキャン点群
-      for (size_t k=0; k<lps.size(); k++) {
-        const LPoint2D *lp = lps[k];
+      NNGridCell &cell = (*tile)[tileOffset(xi, yi)];     // そのセル
+      for (int k=cell.head; k>=0; k=nexts[k]) {     // セルがもつスキャン点群
+        const LPoint2D *lp = pts[k];
         double d = (lp->x - glp.x)*(lp->x - glp.x) + (lp->y - glp.y)*(lp->y - glp.y);
 
         if (d <= dthre*dthre && d < dmin) {         // dthre内で距離が最小となる点を保存
@@ -76,7 +116,7 @@ const LPoint2D *NNGridTable::findClosestPoint(const LPoint2D *clp, const Pose2D
           lpmin = lp;
         }
       }
-      pn += lps.size();
+      pn += cell.num;
     }
   }
 //  printf("pn=%d\n", pn);                 // 探したセル内の点の総数。確認用
@@ -87,43 +127,67 @@ const LPoint2D *NNGridTable::findClosestPoint(const LPoint2D *clp, const Pose2D
 ////////////
 
 // 格子テーブルの各セルの代表点を作ってpsに格納する。
+// 代表点を計算するのは、前回から点が追加されたセルだけ。それ以外は前回の代表点を使う。
 void NNGridTable::makeCellPoints(size_t nthre, vector<LPoint2D> &ps) {
+  // 新しく点が入ったセルを、インデックス順の一覧に加える。代表点の並びはテーブルの順にする
+  if (!newCells.empty()) {
+    auto keyLess = [](const CellRef &a, const CellRef &b) { return(a.first < b.first); };
+    sort(newCells.begin(), newCells.end(), keyLess);
+    mergeBuf.resize(usedCells.size() + newCells.size());     // inplace_mergeは作業領域を毎回確保するので使わない
+    merge(usedCells.begin(), usedCells.end(), newCells.begin(), newCells.end(), mergeBuf.begin(), keyLess);
+    usedCells.swap(mergeBuf);
+    newCells.clear();
+  }
+
+  for (size_t i=0; i<dirtyCells.size(); i++)
+    makeCellPoint(*dirtyCells[i]);                   // 点が追加されたセルの代表点を作り直す
+  dirtyCells.clear();
+
+  for (size_t i=0; i<usedCells.size(); i++) {
+    const NNGridCell &cell = *usedCells[i].second;
+    if (static_cast<size_t>(cell.num) >= nthre)          // 点数がnthreより多いセルだけ使う
+      ps.emplace_back(reps[cell.rep]);   // psに追加
+  }
+
+//  printf("usedCells.size=%zu, reps.size=%zu\n", usedCells.size(), reps.size());     // 確認用
+}
+
+// セルの代表点を作る
+void NNGridTable::makeCellPoint(NNGridCell &cell) {
   // 現状はセル内の各点のスキャン番号の平均をとる。
   // スキャン番号の最新値をとる場合は、その部分のコメントをはずし、
   // 平均とる場合（2行）をコメントアウトする。
 
-  size_t nn=0;                           // テーブル内の全セル数。確認用
-  for (size_t i=0; i<table.size(); i++) {
-    vector<const LPoint2D*> &lps = table[i].lps;      // セルのスキャン点群
-    nn += lps.size();
-    if (lps.size() >= nthre) {           // 点数がnthreより多いセルだけ処理する
-      double gx=0, gy=0;                 // 点群の重心位置
-      double nx=0, ny=0;                 // 点群の法線ベクトルの平均
-      int sid=0;
-      for (size_t j=0; j<lps.size(); j++) {
-        const LPoint2D *lp = lps[j];
-        gx += lp->x;                     // 位置を累積
-        gy += lp->y;
-        nx += lp->nx;                    // 法線ベクトル成分を累積
-        ny += lp->ny;
-        sid += lp->sid;                  // スキャン番号の平均とる場合
-//        if (lp->sid > sid)             // スキャン番号の最新値とる場合
-//          sid = lp->sid;
-//        printf("sid=%d\n", lp->sid);
-      }
-      gx /= lps.size();                  // 平均
-      gy /= lps.size();
-      double L = sqrt(nx*nx + ny*ny);
-      nx /=  L;                          // 平均（正規化）
-      ny /=  L;
-      sid /= static_cast<int>(lps.size());                 // スキャン番号の平均とる場合
-
-      LPoint2D newLp(sid, gx, gy);       // セルの代表点を生成
-      newLp.setNormal(nx, ny);           // 法線ベクトル設定
-      newLp.setType(LINE);               // タイプは直線にする
-      ps.emplace_back(newLp);            // psに追加
-    }
+  double gx=0, gy=0;                 // 点群の重心位置
+  double nx=0, ny=0;                 // 点群の法線ベクトルの平均
+  int sid=0;
+  for (int k=cell.head; k>=0; k=nexts[k]) {     // セルのスキャン点群
+    const LPoint2D *lp = pts[k];
+    gx += lp->x;                     // 位置を累積
+    gy += lp->y;
+    nx += lp->nx;                    // 法線ベクトル成分を累積
+    ny += lp->ny;
+    sid += lp->sid;                  // スキャン番号の平均とる場合
+//    if (lp->sid > sid)             // スキャン番号の最新値とる場合
+//      sid = lp->sid;
+//    printf("sid=%d\n", lp->sid);
   }
-
-//  printf("nn=%d\n", nn);               // テーブル内の全セル数。確認用
+  gx /= cell.num;                    // 平均
+  gy /= cell.num;
+  double L = sqrt(nx*nx + ny*ny);
+  nx /=  L;                          // 平均（正規化）
+  ny /=  L;
+  sid /= cell.num;                   // スキャン番号の平均とる場合
+
+  LPoint2D newLp(sid, gx, gy);       // セルの代表点を生成
+  newLp.setNormal(nx, ny);           // 法線ベクトル設定
+  newLp.setType(LINE);               // タイプは直線にする
+
+  if (cell.rep < 0) {                // 初めて代表点を作るセル
+    cell.rep = static_cast<int>(reps.size());
+    reps.emplace_back(newLp);
+  }
+  else
+    reps[cell.rep] = newLp;
+  cell.dirty = false;
 }
@@ -16,44 +16,80 @@
 #define _NN_GRID_TABLE_H_
 
 #include <vector>
+#include <unordered_map>
+#include <cstdint>
 #include "MyUtil.h"
 #include "Pose2D.h"
 
+// セルの点はセルごとの配列にはもたず、NNGridTable::ptsの中を、登録順にnextsでつないだリストにする
 struct NNGridCell
 {
-  std::vector<const LPoint2D*> lps;         // このセルに格納されたスキャン点群
+  int head;                                 // 最初の点の番号（NNGridTable::ptsの添字）。点がなければ-1
+  int tail;                                 // 最後の点の番号
+  int num;                                  // このセルに格納された点数
+  int rep;                                  // 代表点の番号（NNGridTable::repsの添字）。まだなければ-1
+  bool dirty;                               // 代表点を作った後に点が追加されたか
+
+  NNGridCell() : head(-1), tail(-1), num(0), rep(-1), dirty(false) {
+  }
 
   void clear() {
-    lps.clear();                            // 空にする
+    head = tail = -1;                       // 空にする
+    num = 0;
+    rep = -1;
+    dirty = false;
   }
 };
 
 ///////
 
-// 格子テーブル
+// 格子テーブル。
+// セルはTILE_SIZE x TILE_SIZE個ずつのタイルにまとめ、点が入ったタイルだけ領域を確保する。
+// タイルはハッシュ表で管理するので、対象領域に制限はなく、メモリ量は点のある範囲に比例する。
+// 点の入ったセルとその代表点を覚えておき、clearやmakeCellPointsではそれらのセルだけを処理する。
+// 点を追加し続けても、代表点を作り直すのは前回から点が追加されたセルだけになる。
+// 点はすべてのセルで共有する配列に入れるので、clearの後は前回までの領域を使い回し、メモリ確保は起きない。
 class NNGridTable
 {
 private:
+  static const int TILE_BITS = 5;
+  static const int TILE_SIZE = 1 << TILE_BITS;        // タイルの1辺のセル数
+
+  typedef std::pair<int64_t, NNGridCell*> CellRef;    // セルのキーとセル
+
   double dthre;
   double csize;                       // セルサイズ[m]
-  double rsize;                       // 対象領域のサイズ[m]。正方形の1辺の半分。
-  int tsize;                          // テーブルサイズの半分
-  std::vector<NNGridCell> table;      // テーブル本体
+  std::unordered_map<int64_t, std::vector<NNGridCell>> tiles;   // タイル。キーはタイルの位置
+  int64_t lastTileKey;                // 最後に点を登録したタイルのキー
+  std::vector<NNGridCell> *lastTile;  // 最後に点を登録したタイル。連続する点は同じタイルに入ることが多い
+
+  std::vector<const LPoint2D*> pts;   // 登録した点
+  std::vector<int> nexts;             // 同じセルの次の点の番号。最後の点は-1
+  std::vector<CellRef> usedCells;     // 点が入っているセル。キーの昇順
+  std::vector<CellRef> mergeBuf;      // usedCellsとnewCellsを併合する作業用
+  std::vector<CellRef> newCells;      // 前回のmakeCellPoints以降に初めて点が入ったセル
+  std::vector<NNGridCell*> dirtyCells;  // 前回のmakeCellPoints以降に点が追加されたセル
+  std::vector<LPoint2D> reps;         // セルの代表点
 
 public:
-  NNGridTable() : dthre(0.2), csize(0.05), rsize(40){            // セル5cm、対象領域40x2m四方
-    tsize = static_cast<int>(rsize/csize);           // テーブルサイズの半分
-    size_t w = 2*static_cast<size_t>(tsize)+1;       // テーブルサイズ
-    table.resize(w*w);                               // 領域確保
-    clear();                                         // tableの初期化
+  NNGridTable() : dthre(0.2), csize(0.05), lastTileKey(0), lastTile(nullptr) {            // セル5cm
   }
 
   ~NNGridTable() {
   }
   
+  // 点の入ったセルだけを空にする。タイルの領域は次に使うために残す
   void clear() {
-    for (size_t i=0; i<table.size(); i++)
-      table[i].clear();                         // 各セルを空にする
+    for (size_t i=0; i<usedCells.size(); i++)
+      usedCells[i].second->clear();
+    for (size_t i=0; i<newCells.size(); i++)
+      newCells[i].second->clear();
+    pts.clear();
+    nexts.clear();
+    usedCells.clear();
+    newCells.clear();
+    dirtyCells.clear();
+    reps.clear();
   }
 
   void setDthre(double d) {
@@ -65,6 +101,31 @@ public:
   void addPoint(const LPoint2D *lp);
   const LPoint2D *findClosestPoint(const LPoint2D *clp, const Pose2D &predPose);
   void makeCellPoints(size_t nthre, std::vector<LPoint2D> &ps);
+
+private:
+  // セルの位置(xi, yi)からキーを作る。キーの順序はyi、xiの順の辞書式順序になる
+  static int64_t cellKey(int xi, int yi) {
+    return(static_cast<int64_t>(yi)*4294967296LL + (static_cast<int64_t>(xi) + 2147483648LL));
+  }
+
+  // 位置[m]からセルの位置を求める
+  int cellIndex(double v) const {
+    return(static_cast<int>(v/csize));
+  }
+
+  // セルの位置からタイルの位置を求める。算術シフトなので負の位置でも切り下げになる
+  static int tileIndex(int i) {
+    return(i >> TILE_BITS);
+  }
+
+  // セルの位置から、タイル内での位置を求める
+  static int tileOffset(int xi, int yi) {
+    return((yi & (TILE_SIZE-1))*TILE_SIZE + (xi & (TILE_SIZE-1)));
+  }
+
+  std::vector<NNGridCell> *findTile(int ti, int tj);
+  NNGridCell &getCell(int xi, int yi);
+  void makeCellPoint(NNGridCell &cell);
 };
 
 #endif
@@ -0,0 +1,125 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file PointCloud2D.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef POINT_CLOUD2D_H_
+#define POINT_CLOUD2D_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "LPoint2D.h"
+
+////////
+
+// 点群を成分ごとの配列で持つ。
+// LPoint2Dの配列では1点が1つの構造体なので、xやyだけを使うループでも構造体全体を読むことになる。
+// ここでは成分ごとに連続した配列にしておき、ICPの内側のループがx, y, nx, nyだけを順に読めるようにする。
+struct PointCloud2D
+{
+  std::vector<int> sid;                // スキャン番号
+  std::vector<double> x;               // 位置x
+  std::vector<double> y;               // 位置y
+  std::vector<double> nx;              // 法線ベクトル
+  std::vector<double> ny;              // 法線ベクトル
+  std::vector<ptype> type;             // 点のタイプ
+
+  PointCloud2D() {
+  }
+
+  explicit PointCloud2D(const std::vector<LPoint2D> &lps) {
+    setPoints(lps);
+  }
+
+  ~PointCloud2D() {
+  }
+
+///////
+
+  size_t size() const {
+    return(x.size());
+  }
+
+  bool empty() const {
+    return(x.empty());
+  }
+
+  void clear() {
+    sid.clear();
+    x.clear();
+    y.clear();
+    nx.clear();
+    ny.clear();
+    type.clear();
+  }
+
+  void reserve(size_t n) {
+    sid.reserve(n);
+    x.reserve(n);
+    y.reserve(n);
+    nx.reserve(n);
+    ny.reserve(n);
+    type.reserve(n);
+  }
+
+  // 容量が足りないときだけ、余裕をもって広げる。
+  // 使い回す点群で、点数が前回より少し増えるたびに確保し直さないようにする
+  void reserveMore(size_t n) {
+    if (n > x.capacity())
+      reserve(n + n/2);
+  }
+
+  void push_back(const LPoint2D &lp) {
+    sid.push_back(lp.sid);
+    x.push_back(lp.x);
+    y.push_back(lp.y);
+    nx.push_back(lp.nx);
+    ny.push_back(lp.ny);
+    type.push_back(lp.type);
+  }
+
+  // i番目の点をLPoint2Dにして返す。累積走行距離は持っていないので0になる
+  LPoint2D getPoint(size_t i) const {
+    LPoint2D lp(sid[i], x[i], y[i]);
+    lp.setNormal(nx[i], ny[i]);
+    lp.setType(type[i]);
+    return(lp);
+  }
+
+///////
+
+  // LPoint2Dの配列から作る。Scan2DのlpsやPointCloudMapのlocalMapなど
+  void setPoints(const std::vector<LPoint2D> &lps) {
+    clear();
+    reserveMore(lps.size());
+    for (size_t i=0; i<lps.size(); i++)
+      push_back(lps[i]);
+  }
+
+  // LPoint2Dのポインタの配列から作る。DataAssociatorの対応結果など
+  void setPoints(const std::vector<const LPoint2D*> &lps) {
+    clear();
+    reserveMore(lps.size());
+    for (size_t i=0; i<lps.size(); i++)
+      push_back(*lps[i]);
+  }
+
+  // LPoint2Dの配列に戻す
+  void getPoints(std::vector<LPoint2D> &lps) const {
+    lps.clear();
+    lps.reserve(size());
+    for (size_t i=0; i<size(); i++)
+      lps.emplace_back(getPoint(i));
+  }
+};
+
+#endif
@@ -18,23 +18,68 @@ using namespace std;
 
 //////////////
 
-// 初期値initPoseを与えて、ICPによりロボット位置の推定値estPoseを求める
+// 初期値initPoseを与えて、ICPによりロボット位置の推定値estPoseを求める。
+// levelNum>1なら、現在スキャンを間引いた粗い階層から順にICPを行い、その結果を次の細かい階層の初期値にする。
+// 粗い階層では現在スキャンも参照スキャンも間引くので対応づけが速く、距離閾値を広げて大きなずれも取り込む。
 double PoseEstimatorICP::estimatePose(Pose2D &initPose, Pose2D &estPose){
   chrono_time t0 = clock();
 
+  popt->setEvlimit(0.2);               // evlimitは外れ値の閾値[m]
+
+  Pose2D pose = initPose;
+  DataAssociator *dass0 = dass;
+  for (int lv=static_cast<int>(coarseDass.size()); lv>0; lv--) {
+    makeCoarseScan(1 << lv);           // 2^lv点おきに間引く
+    dass = coarseDass[lv-1];           // 階層lvの参照スキャンで対応づける
+    Pose2D lvPose;
+    iterateIcp(&coarseScan, pose, lvPose);
+    pose = lvPose;
+  }
+  dass = dass0;
+
+  double evmin = iterateIcp(curScan, pose, estPose);      // 元の点群で仕上げる
+
+  // ガウスニュートン法などはコスト関数を使わないので、点の対応率は更新されない。
+  // そのため、最後の対応づけの結果で推定位置のコストを計算して、対応率を求める
+  CostFunction *cfunc = popt->getCostFunction();
+  cfunc->setPoints(dass->curLps, dass->refLps);
+  cfunc->calValue(estPose.tx, estPose.ty, estPose.th);
+  pnrate = cfunc->getPnrate();
+  usedNum = dass->curLps.size();
+
+  printf("finalError=%g, pnrate=%g\n", evmin, pnrate);
+  printf("estPose:  tx=%g, ty=%g, th=%g\n", estPose.tx, estPose.ty, estPose.th);      // 確認用
+
+  chrono_time t1 = clock();
+  double dur = duration(t0, t1);
+  printf("PoseEstimatorICP: dur=%g\n", dur);                 // 処理時間
+
+  if (evmin < HUGE_VAL)
+    totalError += evmin;                                   // 誤差合計
+  totalTime += dur;                                         // 処理時間合計
+  printf("totalError=%g, totalTime=%g\n", totalError, totalTime);    // 確認用
+
+  dass->averageProcTime();
+  popt->averageProcTime();
+
+  return(evmin);
+}
+
+// スキャンscanについて、データ対応づけと最適化を収束するまで繰り返す。コスト最小の位置をestPoseに入れ、そのコストを返す
+double PoseEstimatorICP::iterateIcp(const Scan2D *scan, const Pose2D &initPose, Pose2D &estPose) {
   double evmin = HUGE_VAL;             // コスト最小値。初期値は大きく
   double evthre = 0.000001;            // コスト変化閾値。変化量がこれ以下なら繰り返し終了
 //  double evthre = 0.00000001;            // コスト変化閾値。変化量がこれ以下なら繰り返し終了
   popt->setEvthre(evthre);
-  popt->setEvlimit(0.2);               // evlimitは外れ値の閾値[m]
   double ev = 0;                       // コスト
   double evold = evmin;                // 1つ前の値。収束判定のために使う。
   Pose2D pose = initPose;
   Pose2D poseMin = initPose;
+  dass->clearReuse();                  // 対応の使い回しは、この繰り返しの中だけにする
   for (int i=0; abs(evold-ev) > evthre && i<100; i++) {           // i<100は振動対策
     if (i > 0)
       evold = ev;
-    dass->findCorrespondence(curScan, pose);      // データ対応づけ
+    dass->findCorrespondence(scan, pose);         // データ対応づけ
     Pose2D newPose;
     popt->setPoints(dass->curLps, dass->refLps);                  // 対応結果を渡す
     ev = popt->optimizePose(pose, newPose);                       // その対応づけにおいてロボット位置の最適化
@@ -46,29 +91,56 @@ double PoseEstimatorICP::estimatePose(Pose2D &initPose, Pose2D &estPose){
     }
 
 //    printf("dass.curLps.size=%zu, dass.refLps.size=%zu\n", dass->curLps.size(), dass->refLps.size());
-//    printf("mratio=%g\n", mratio);
 //    printf("i=%d: ev=%g, evold=%g\n", i, ev, evold);
   }
 
-  pnrate = popt->getPnrate();
-  usedNum = dass->curLps.size();
-
   estPose = poseMin;
 
-  printf("finalError=%g, pnrate=%g\n", evmin, pnrate);
-  printf("estPose:  tx=%g, ty=%g, th=%g\n", pose.tx, pose.ty, pose.th);      // 確認用
+  return(evmin);
+}
 
-  chrono_time t1 = clock();
-  double dur = duration(t0, t1);
-  printf("PoseEstimatorICP: dur=%g\n", dur);                 // 処理時間
+// 現在スキャンの点をstep点おきに取り出して、粗い階層のスキャンを作る
+void PoseEstimatorICP::makeCoarseScan(int step) {
+  coarseScan.sid = curScan->sid;
+  coarseScan.pose = curScan->pose;
+  coarseScan.lps.clear();
+  for (size_t i=0; i<curScan->lps.size(); i+=step)
+    coarseScan.lps.push_back(curScan->lps[i]);
+}
 
-  if (evmin < HUGE_VAL)
-    totalError += evmin;                                   // 誤差合計
-  totalTime += dur;                                         // 処理時間合計
-  printf("totalError=%g, totalTime=%g\n", totalError, totalTime);    // 確認用
+// 粗い階層ごとに、参照点群refLpsを2^lv点おきに間引いて、その階層のデータ対応づけ器に登録する。
+// 距離閾値は、元の閾値のlevelDthreScale^lv倍にする。refPoseは参照スキャンの計測位置で、なければnullptr
+void PoseEstimatorICP::setCoarseRefs(const vector<LPoint2D> &refLps, const Pose2D *refPose) {
+  size_t ln = static_cast<size_t>(levelNum-1);
+  if (coarseDass.size() != ln) {                     // 階層ごとのデータ対応づけ器を作る
+    deleteCoarseDass();
+    for (size_t k=0; k<ln; k++)
+      coarseDass.push_back(dass->clone());
+    coarseRefs.resize(ln);
+  }
 
-  dass->averageProcTime();
-  popt->averageProcTime();
+  double dthre = dass->getDthre();
+  for (int lv=1; lv<=levelNum-1; lv++) {
+    Scan2D &ref = coarseRefs[lv-1];
+    if (refPose != nullptr)
+      ref.pose = *refPose;
+    ref.lps.clear();
+    for (size_t i=0; i<refLps.size(); i+=(1 << lv))
+      ref.lps.push_back(refLps[i]);
 
-  return(evmin);
+    DataAssociator *d = coarseDass[lv-1];
+    d->setDthre(dthre*pow(levelDthreScale, lv));     // 登録前に閾値を決める（格子の大きさに使うクラスがある）
+    if (refPose != nullptr)
+      d->setRefScan(&ref);
+    else
+      d->setRefBase(ref.lps);
+  }
+}
+
+// 粗い階層のデータ対応づけ器を消す
+void PoseEstimatorICP::deleteCoarseDass() {
+  for (size_t k=0; k<coarseDass.size(); k++)
+    delete coarseDass[k];
+  coarseDass.clear();
+  coarseRefs.clear();
 }
@@ -35,16 +35,32 @@ private:
   PoseOptimizer *popt;         // 最適化クラス
   DataAssociator *dass;        // データ対応づけクラス
 
+  int levelNum;                // 粗密探索の階層数。1なら元の点群だけを使う
+  double levelDthreScale;      // 1階層粗くするごとに、対応づけの距離閾値を何倍にするか
+  Scan2D coarseScan;           // 現在スキャンを間引いた点群。粗い階層で使う
+
+  // 粗い階層ごとの参照スキャンとデータ対応づけ器。[lv-1]が階層lvのもの。
+  // データ対応づけ器はdassの複製で、距離閾値を広げて間引いた参照スキャンを登録する
+  std::vector<Scan2D> coarseRefs;
+  std::vector<DataAssociator*> coarseDass;
+
 public:
   double totalError;           // 誤差合計
   double totalTime;            // 処理時間合計
 
 public:
 
-  PoseEstimatorICP() : curScan(nullptr), usedNum(0), pnrate(0), popt(nullptr), dass(nullptr), totalError(0), totalTime(0) {
+  PoseEstimatorICP() : curScan(nullptr), usedNum(0), pnrate(0), popt(nullptr), dass(nullptr), levelNum(1), levelDthreScale(2), totalError(0), totalTime(0) {
+  }
+
+  // 複製では、粗い階層の部品は引き継がず、次のsetScanPairで作り直す
+  PoseEstimatorICP(const PoseEstimatorICP &p) : curScan(p.curScan), usedNum(p.usedNum), pnrate(p.pnrate), popt(p.popt), dass(p.dass), levelNum(p.levelNum), levelDthreScale(p.levelDthreScale), totalError(p.totalError), totalTime(p.totalTime) {
   }
 
+  PoseEstimatorICP &operator=(const PoseEstimatorICP &) = delete;
+
   ~PoseEstimatorICP() {
+    deleteCoarseDass();
   }
 
 ///////
@@ -54,8 +70,26 @@ public:
   }
 
   void setDataAssociator(DataAssociator *d) {
+    if (d != dass)
+      deleteCoarseDass();
     dass = d;
   }
+
+  PoseOptimizer *getPoseOptimizer() {
+    return(popt);
+  }
+
+  DataAssociator *getDataAssociator() {
+    return(dass);
+  }
+
+  // 粗密探索の階層数nと、階層ごとの距離閾値の倍率sを設定。
+  // 粗い階層は点が少ないので、既定では1階層ごとに閾値を2倍に広げて大きなずれを取り込む
+  void setLevelNum(int n, double s=2) {
+    levelNum = (n > 0) ? n : 1;
+    levelDthreScale = s;
+    deleteCoarseDass();
+  }
      
   double getPnrate() {
     return(pnrate);
@@ -67,17 +101,27 @@ public:
   
   void setScanPair(const Scan2D *c, const Scan2D *r) {
     curScan = c;
-    dass->setRefBase(r->lps);           // データ対応づけのために参照スキャン点を登録
+    dass->setRefScan(r);                // データ対応づけのために参照スキャン点を登録
+    if (levelNum > 1)
+      setCoarseRefs(r->lps, &r->pose);
   }
 
   void setScanPair(const Scan2D *c, const std::vector<LPoint2D> &refLps) {
     curScan = c;
     dass->setRefBase(refLps);           // データ対応づけのために参照スキャン点を登録
+    if (levelNum > 1)
+      setCoarseRefs(refLps, nullptr);
   }
 
 ////////////
 
   double estimatePose(Pose2D &initPose, Pose2D &estPose);
+
+private:
+  double iterateIcp(const Scan2D *scan, const Pose2D &initPose, Pose2D &estPose);
+  void makeCoarseScan(int step);
+  void setCoarseRefs(const std::vector<LPoint2D> &refLps, const Pose2D *refPose);
+  void deleteCoarseDass();
 };
 
 #endif
@@ -46,8 +46,12 @@ public:
     dass = d;
   }
 
+  DataAssociator *getDataAssociator() {
+    return(dass);
+  }
+
   void setRefScan(const Scan2D *refScan) {
-    dass->setRefBase(refScan->lps);
+    dass->setRefScan(refScan);
   }
 
   void setRefLps(const std::vector<LPoint2D> &refLps) {
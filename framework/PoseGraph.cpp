@@ -67,6 +67,18 @@ PoseArc *PoseGraph::makeArc(int srcNid, int dstNid, const Pose2D &relPose, const
   return(arc);
 }
 
+// 別のポーズグラフのアークaと同じノードIDの間に、同じ拘束のアークを生成する。
+// ノードIDは通し番号なので、両方のグラフに同じ順でノードを追加していれば同じノードを指す
+PoseArc *PoseGraph::copyArc(const PoseArc &a) {
+  PoseNode *src = nodes[a.src->nid];            // 始点ノード
+  PoseNode *dst = nodes[a.dst->nid];            // 終点ノード
+
+  PoseArc *arc = allocArc();                    // アークの生成
+  arc->setup(src, dst, a.relPose, a.inf);       // 情報行列はそのまま使う
+
+  return(arc);
+}
+
 // 始点ノードがsrcNid、終点ノードがdstNidであるアークを返す
 PoseArc *PoseGraph::findArc(int srcNid, int dstNid) {
   for (size_t i=0; i<arcs.size(); i++) {
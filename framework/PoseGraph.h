@@ -72,7 +72,7 @@ struct PoseArc
   Eigen::Matrix3d inf;                // 情報行列
   double sw;                        // ロバスト化用のswitch変数
 
-  PoseArc(void) : src(nullptr), dst(nullptr), sw(1) {
+  PoseArc(void) : src(nullptr), dst(nullptr), inf(Eigen::Matrix3d::Zero()), sw(1) {
   }
 
   PoseArc(PoseNode *s, PoseNode *d, Pose2D &rel, const Eigen::Matrix3d _inf) : sw(1) {
@@ -155,6 +155,7 @@ public:
 
   void addArc(PoseArc *arc);
   PoseArc *makeArc(int srcNid, int dstNid, const Pose2D &relPose, const Eigen::Matrix3d &cov);
+  PoseArc *copyArc(const PoseArc &a);
   PoseArc *findArc(int srcNid, int dstNid);
 
   void printNodes();
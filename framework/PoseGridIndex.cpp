@@ -0,0 +1,74 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file PoseGridIndex.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <algorithm>
+#include "PoseGridIndex.h"
+
+using namespace std;
+
+////////
+
+// ロボット位置pを次の番号で登録する。累積走行距離は、直前のロボット位置（最初は原点）からの距離を足して求める
+void PoseGridIndex::addPose(const Pose2D &p) {
+  double px = 0, py = 0;
+  double atd = 0;
+  if (!poses.empty()) {
+    px = poses.back().tx;
+    py = poses.back().ty;
+    atd = atds.back();
+  }
+  atd += sqrt((p.tx - px)*(p.tx - px) + (p.ty - py)*(p.ty - py));
+
+  cells[cellKey(cellIndex(p.tx), cellIndex(p.ty))].push_back(poses.size());
+  poses.emplace_back(p);
+  atds.push_back(atd);
+}
+
+// 累積走行距離がatdMax以下のロボット位置の数を返す。それらは番号の先頭から並んでいる
+size_t PoseGridIndex::countAtd(double atdMax) const {
+  return(upper_bound(atds.begin(), atds.end(), atdMax) - atds.begin());
+}
+
+// 番号がn未満のロボット位置のうち、位置pから半径radius[m]以内にあるものを、近い順にk個までidsに入れる。
+// 距離が同じなら番号の小さい方を先にする
+void PoseGridIndex::findNearPoses(const Pose2D &p, double radius, size_t n, size_t k, vector<size_t> &ids) const {
+  ids.clear();
+  n = min(n, poses.size());
+  if (n == 0 || k == 0)
+    return;
+
+  double r2 = radius*radius;
+  vector<pair<double, size_t>> found;                  // 距離の2乗と番号
+  int xa = cellIndex(p.tx - radius), xb = cellIndex(p.tx + radius);
+  int ya = cellIndex(p.ty - radius), yb = cellIndex(p.ty + radius);
+  for (int yi=ya; yi<=yb; yi++) {
+    for (int xi=xa; xi<=xb; xi++) {
+      auto it = cells.find(cellKey(xi, yi));
+      if (it == cells.end())
+        continue;
+      const vector<size_t> &cell = it->second;         // 番号は昇順に入っている
+      for (size_t j=0; j<cell.size() && cell[j]<n; j++) {
+        const Pose2D &q = poses[cell[j]];
+        double d = (p.tx - q.tx)*(p.tx - q.tx) + (p.ty - q.ty)*(p.ty - q.ty);
+        if (d <= r2)
+          found.emplace_back(d, cell[j]);
+      }
+    }
+  }
+
+  k = min(k, found.size());
+  partial_sort(found.begin(), found.begin()+k, found.end());
+  for (size_t i=0; i<k; i++)
+    ids.push_back(found[i].second);
+}
@@ -0,0 +1,85 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file PoseGridIndex.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef POSE_GRID_INDEX_H_
+#define POSE_GRID_INDEX_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "MyUtil.h"
+#include "Pose2D.h"
+
+////////
+
+// ロボット軌跡の格子索引。ループ検出で、ある位置の近くを通った過去のロボット位置を探すのに使う。
+// ロボット位置を番号順に登録し、各セルにその番号を入れておく。
+// 原点から各ロボット位置までの累積走行距離も登録順に覚えておくので、
+// 走行距離がある値以下の範囲（番号の先頭からの範囲）は二分探索で求まる。
+class PoseGridIndex
+{
+private:
+  double csize;                                        // セルサイズ[m]
+  std::unordered_map<int64_t, std::vector<size_t>> cells;   // セルごとのロボット位置の番号。キーはセルの位置
+  std::vector<Pose2D> poses;                           // 登録したロボット位置
+  std::vector<double> atds;                            // 各ロボット位置までの累積走行距離
+
+public:
+  PoseGridIndex() : csize(4) {
+  }
+
+  ~PoseGridIndex() {
+  }
+
+  // セルサイズを変えると、登録し直しになる
+  void setCellSize(double c) {
+    if (c != csize)
+      clear();
+    csize = c;
+  }
+
+  void clear() {
+    cells.clear();
+    poses.clear();
+    atds.clear();
+  }
+
+  size_t size() const {
+    return(poses.size());
+  }
+
+  // i番目のロボット位置までの累積走行距離
+  double getAtd(size_t i) const {
+    return(atds[i]);
+  }
+
+////////
+
+  void addPose(const Pose2D &p);
+  size_t countAtd(double atdMax) const;
+  void findNearPoses(const Pose2D &p, double radius, size_t n, size_t k, std::vector<size_t> &ids) const;
+
+private:
+  // セルの位置(xi, yi)からキーを作る
+  static int64_t cellKey(int xi, int yi) {
+    return(static_cast<int64_t>(yi)*4294967296LL + (static_cast<int64_t>(xi) + 2147483648LL));
+  }
+
+  // 位置[m]からセルの位置を求める。負の位置でも切り下げにする
+  int cellIndex(double v) const {
+    return(static_cast<int>(floor(v/csize)));
+  }
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include "LPoint2D.h"
 #include "Pose2D.h"
 #include "CostFunction.h"
+#include "DistanceField2D.h"
 
 class PoseOptimizer
 {
@@ -42,7 +43,7 @@ public:
     allN=0; sum=0;
   }
 
-  ~PoseOptimizer() {
+  virtual ~PoseOptimizer() {
   }
 
 /////
@@ -51,6 +52,10 @@ public:
     cfunc = f;
   }
 
+  CostFunction *getCostFunction() {
+    return(cfunc);
+  }
+
   void setEvlimit(double l) {
     cfunc->setEvlimit(l);
   }
@@ -79,7 +84,16 @@ public:
 
 ////////
 
+  // 同じ設定の複製を作る。コスト関数は同じものを指すので、別スレッドで使うときはsetCostFunctionで差し替える
+  virtual PoseOptimizer *clone() const = 0;
+
   virtual double optimizePose(Pose2D &initPose, Pose2D &estPose) = 0;
+
+  // 距離場dfの上で、点群lpsの位置を直接最適化する。距離場に対応した最適化クラスだけが実装する
+  virtual double optimizePoseDF(const DistanceField2D &df, const std::vector<LPoint2D> &lps, Pose2D &initPose, Pose2D &estPose) {
+    estPose = initPose;
+    return(HUGE_VAL);
+  }
 };
 
 #endif 
@@ -16,6 +16,7 @@
 #define SCAN2D_H_
 
 #include <vector>
+#include <utility>
 #include "MyUtil.h"
 #include "LPoint2D.h"
 #include "Pose2D.h"
@@ -47,6 +48,11 @@ struct Scan2D
   void setLps (const std::vector<LPoint2D> &ps) {
     lps = ps;
   }
+
+  // psの中身をコピーせずに移す
+  void setLps (std::vector<LPoint2D> &&ps) {
+    lps = std::move(ps);
+  }
   
   void setPose(Pose2D &p) {
     pose = p;
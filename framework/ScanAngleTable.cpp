@@ -0,0 +1,83 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanAngleTable.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <cstring>
+#include "ScanAngleTable.h"
+
+// x86-64ではSSE2は必ず使えるので、SSE2版を使う
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_ANGLE_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+////////
+
+// 方位の並びasが前回と違えば、表を作り直す。作り直したらtrueを返す。
+bool ScanAngleTable::update(const float *as, size_t n, int offset) {
+  if (n == angles.size() && offset == angleOffset && (n == 0 || memcmp(as, angles.data(), n*sizeof(float)) == 0))
+    return(false);                               // 前回と同じ並びなので、そのまま使う
+
+  angles.assign(as, as+n);
+  angleOffset = offset;
+  cosTab.resize(n);
+  sinTab.resize(n);
+  for (size_t i=0; i<n; i++) {
+    double a = DEG2RAD(angles[i] + angleOffset); // レーザスキャナの方向オフセットを考慮
+    cosTab[i] = cos(a);
+    sinTab[i] = sin(a);
+  }
+  ++makeNum;
+
+  return(true);
+}
+
+// 距離値rangesを表の方位でxyに変換して、lpsの末尾に追加する。
+// 距離がrmin以下またはrmax以上の点は、同じ処理の中で除外する。
+void ScanAngleTable::convert(const float *ranges, size_t n, int sid, double rmin, double rmax, vector<LPoint2D> &lps) const {
+  if (n > angles.size())
+    n = angles.size();
+
+  size_t i=0;
+#ifdef SCAN_ANGLE_TABLE_SSE2
+  // 2点ずつまとめて、範囲判定とxyの計算をする
+  const __m128d vmin = _mm_set1_pd(rmin);
+  const __m128d vmax = _mm_set1_pd(rmax);
+  alignas(16) double xs[2], ys[2];
+  for (; i+2<=n; i+=2) {
+    __m128 rf = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ranges+i)));   // float 2個を読む
+    __m128d r = _mm_cvtps_pd(rf);
+    __m128d inside = _mm_and_pd(_mm_cmpgt_pd(r, vmin), _mm_cmplt_pd(r, vmax));
+    int mask = _mm_movemask_pd(inside);
+    if (mask == 0)                               // 2点とも範囲外
+      continue;
+
+    _mm_store_pd(xs, _mm_mul_pd(r, _mm_loadu_pd(&cosTab[i])));
+    _mm_store_pd(ys, _mm_mul_pd(r, _mm_loadu_pd(&sinTab[i])));
+    if (mask & 1)
+      lps.emplace_back(sid, xs[0], ys[0]);
+    if (mask & 2)
+      lps.emplace_back(sid, xs[1], ys[1]);
+  }
+#endif
+
+  // 残りの点（SSE2がなければ全部）
+  for (; i<n; i++) {
+    double r = ranges[i];
+    if (r <= rmin || r >= rmax)
+      continue;
+    lps.emplace_back(sid, r*cosTab[i], r*sinTab[i]);
+  }
+}
@@ -0,0 +1,58 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanAngleTable.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef SCAN_ANGLE_TABLE_H_
+#define SCAN_ANGLE_TABLE_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "LPoint2D.h"
+
+////////
+
+// スキャン点の方位ごとのcos, sinの表。
+// レーザスキャナの方位の並びは毎回同じなので、最初に1回だけ三角関数を計算しておく。
+class ScanAngleTable
+{
+private:
+  std::vector<float> angles;           // 表を作ったときの方位[度]。オフセットを加える前の値
+  int angleOffset;                     // 表を作ったときの方向オフセット[度]
+  std::vector<double> cosTab;          // 各方位のcos。オフセット込み
+  std::vector<double> sinTab;          // 各方位のsin。オフセット込み
+  size_t makeNum;                      // 表を作り直した回数（確認用）
+
+public:
+  ScanAngleTable() : angleOffset(0), makeNum(0) {
+  }
+
+  ~ScanAngleTable() {
+  }
+
+////////
+
+  size_t size() const {
+    return(angles.size());
+  }
+
+  size_t getMakeNum() const {
+    return(makeNum);
+  }
+
+////////
+
+  bool update(const float *as, size_t n, int offset);
+  void convert(const float *ranges, size_t n, int sid, double rmin, double rmax, std::vector<LPoint2D> &lps) const;
+};
+
+#endif
@@ -35,13 +35,13 @@ bool ScanMatcher2D::matchScan(Scan2D &curScan) {
   // 最初のスキャンは単に地図に入れるだけ
   if (cnt == 0) {
     growMap(curScan, initPose);
-    prevScan = curScan;                      // 直前スキャンの設定
+    prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
     return(true);
   }
 
   // Scanに入っているオドメトリ値を用いて移動量を計算する
   Pose2D odoMotion;                                                   // オドメトリに基づく移動量
-  Pose2D::calRelativePose(curScan.pose, prevScan.pose, odoMotion);    // 前スキャンとの相対位置が移動量
+  Pose2D::calRelativePose(curScan.pose, prevOdom, odoMotion);         // 前スキャンとの相対位置が移動量
 
   Pose2D lastPose = pcmap->getLastPose();                        // 直前位置
   Pose2D predPose;                                               // オドメトリによる予測位置
@@ -62,6 +62,21 @@ bool ScanMatcher2D::matchScan(Scan2D &curScan) {
     successful = false;
   printf("score=%g, usedNum=%zu, successful=%d\n", score, usedNum, successful);
 
+  // ICPに失敗したら、相関マッチングで予測位置の周囲から初期値を探し直して、もう一度ICPを行う
+  if (!successful && cmat != nullptr) {
+    double rangeT = 0.5;                                         // 並進の探索範囲[m]
+    double rangeA = 20;                                          // 回転の探索範囲[度]
+    cmat->setRefPoints(refScan->lps);
+    Pose2D cmPose;
+    double cmScore;
+    if (cmat->findPose(curScan.lps, predPose, rangeT, rangeA, cmPose, cmScore)) {
+      score = estim->estimatePose(cmPose, estPose);
+      usedNum = estim->getUsedNum();
+      successful = (score <= scthre && usedNum >= nthre);
+      printf("retry: cmScore=%g, score=%g, usedNum=%zu, successful=%d\n", cmScore, score, usedNum, successful);
+    }
+  }
+
   if (dgcheck) {                         // 退化の対処をする場合
     if (successful) {
       Pose2D fusedPose;                       // 融合結果
@@ -91,7 +106,7 @@ bool ScanMatcher2D::matchScan(Scan2D &curScan) {
   }
 
   growMap(curScan, estPose);               // 地図にスキャン点群を追加
-  prevScan = curScan;                      // 直前スキャンの設定
+  prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
 
   // 確認用
 //  printf("lastPose: tx=%g, ty=%g, th=%g\n", lastPose.tx, lastPose.ty, lastPose.th);
@@ -105,8 +120,10 @@ bool ScanMatcher2D::matchScan(Scan2D &curScan) {
 //  PoseCov pcov(estPose, cov);
 //  PoseCov pcov(estPose, totalCov);
 //  PoseCov pcov(estPose, pfu->mcov);
-  PoseCov pcov(estPose, pfu->ecov);
-  poseCovs.emplace_back(pcov);
+  if (savePoseCov) {
+    PoseCov pcov(estPose, pfu->ecov);
+    poseCovs.emplace_back(pcov);
+  }
 
   // 累積走行距離の計算（確認用）
   Pose2D estMotion;                                                    // 推定移動量
@@ -126,7 +143,7 @@ void ScanMatcher2D::growMap(const Scan2D &scan, const Pose2D &pose) {
   double tx = pose.tx;
   double ty = pose.ty;
 
-  vector<LPoint2D> scanG;                                // 地図座標系での点群
+  scanG.clear();                                         // 地図座標系での点群
   for(size_t i=0; i<lps.size(); i++) {
     const LPoint2D &lp = lps[i];
     if (lp.type == ISOLATE)                              // 孤立点（法線なし）は除外
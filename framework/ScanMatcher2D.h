@@ -26,6 +26,7 @@
 #include "ScanPointAnalyser.h"
 #include "PoseEstimatorICP.h"
 #include "PoseFuser.h"
+#include "CorrelativeMatcher.h"
 
 // ICPを用いてスキャンマッチングを行う
 class ScanMatcher2D
@@ -33,7 +34,7 @@ class ScanMatcher2D
 //private:
 protected:
   int cnt;                                // 論理時刻。スキャン番号に対応
-  Scan2D prevScan;                        // 1つ前のスキャン
+  Pose2D prevOdom;                        // 1つ前のスキャンのオドメトリ値。移動量の計算にはこれだけ使う
   Pose2D initPose;                        // 地図の原点の位置。通常(0,0,0)
 
   double scthre;                          // スコア閾値。これより大きいとICP失敗とみなす
@@ -47,13 +48,16 @@ protected:
   ScanPointAnalyser *spana;               // スキャン点法線計算
   RefScanMaker *rsm;                      // 参照スキャン生成
   PoseFuser *pfu;                         // センサ融合器
+  CorrelativeMatcher *cmat;               // ICP失敗時に初期位置を探し直す相関マッチング。nullptrなら使わない
   Eigen::Matrix3d cov;                    // ロボット移動量の共分散行列
   Eigen::Matrix3d totalCov;               // ロボット位置の共分散行列
+  std::vector<LPoint2D> scanG;            // 地図座標系での点群。作業用で、スキャンごとに使い回す
 
   std::vector<PoseCov> poseCovs;          // デバッグ用
+  bool savePoseCov;                       // poseCovsに保存するか。保存するとスキャンごとに配列が伸びる
 
 public:
-  ScanMatcher2D() : cnt(-1), scthre(1.0), nthre(50), atd(0), dgcheck(false), estim(nullptr), pcmap(nullptr), spres(nullptr), spana(nullptr), rsm(nullptr), pfu(nullptr) {
+  ScanMatcher2D() : cnt(-1), scthre(1.0), nthre(50), atd(0), dgcheck(false), estim(nullptr), pcmap(nullptr), spres(nullptr), spana(nullptr), rsm(nullptr), pfu(nullptr), cmat(nullptr), savePoseCov(false) {
   }
 
   ~ScanMatcher2D() {
@@ -69,6 +73,10 @@ public:
     pfu = p;
   }
 
+  void setCorrelativeMatcher(CorrelativeMatcher *c) {
+    cmat = c;
+  }
+
   void setScanPointResampler(ScanPointResampler *s) {
     spres = s;
   }
@@ -108,6 +116,10 @@ public:
   }
 
   // デバッグ用
+  void setSavePoseCov(bool t) {
+    savePoseCov = t;
+  }
+
   std::vector<PoseCov> &getPoseCovs() {
     return(poseCovs);
   }
@@ -0,0 +1,107 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanMatcherDF.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include "ScanMatcherDF.h"
+
+using namespace std;
+
+/////////
+
+// スキャンマッチングの実行
+bool ScanMatcherDF::matchScan(Scan2D &curScan) {
+  ++cnt;
+
+  printf("----- ScanMatcherDF: cnt=%d start -----\n", cnt);
+
+  // spresが設定されていれば、スキャン点間隔を均一化する
+  if (spres != nullptr)
+    spres->resamplePoints(&curScan);
+
+  // spanaが設定されていれば、スキャン点の法線を計算する
+  if (spana != nullptr)
+    spana->analysePoints(curScan.lps);
+
+  // 最初のスキャンは単に地図に入れるだけ
+  if (cnt == 0) {
+    growMap(curScan, initPose);
+    dfield.build(scanG);
+    buildCnt = cnt;
+    lastEst = initPose;
+    prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
+    return(true);
+  }
+
+  // Scanに入っているオドメトリ値を用いて移動量を計算する
+  Pose2D odoMotion;                                                   // オドメトリに基づく移動量
+  Pose2D::calRelativePose(curScan.pose, prevOdom, odoMotion);         // 前スキャンとの相対位置が移動量
+
+  Pose2D lastPose = pcmap->getLastPose();                        // 直前位置
+  Pose2D predPose;                                               // オドメトリによる予測位置
+  Pose2D::calGlobalPose(odoMotion, lastPose, predPose);          // 直前位置に移動量を加えて予測位置を得る
+
+  // ループ閉じ込みで地図が修正されていたら、距離場を作り直す
+  if (lastPose.tx != lastEst.tx || lastPose.ty != lastEst.ty || lastPose.th != lastEst.th) {
+    if (!pcmap->localMap.empty())
+      dfield.build(pcmap->localMap);
+    buildCnt = cnt;
+  }
+
+  Pose2D estPose;                                                // 距離場による推定位置
+  popt->optimizePoseDF(dfield, curScan.lps, predPose, estPose);  // 予測位置を初期値にして最適化
+  size_t usedNum;
+  double score = dfield.evaluate(curScan.lps, estPose, dthre, usedNum);
+
+  bool successful;                                               // スキャンマッチングに成功したかどうか
+  if (score <= scthre && usedNum >= nthre)                       // スコアが閾値より小さければ成功とする
+    successful = true;
+  else
+    successful = false;
+  printf("score=%g, usedNum=%zu, successful=%d\n", score, usedNum, successful);
+
+  if (!successful)
+    estPose = predPose;
+
+  // 対応づけをしないので、オドメトリアークの共分散はオドメトリから求める
+  if (pfu != nullptr)
+    pfu->calOdometryCovariance(odoMotion, lastPose, cov);
+
+  growMap(curScan, estPose);               // 地図にスキャン点群を追加
+  updateField();                           // 距離場にも追加
+  lastEst = estPose;
+  prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
+
+  // 確認用
+  printf("predPose: tx=%g, ty=%g, th=%g\n", predPose.tx, predPose.ty, predPose.th);
+  printf("estPose: tx=%g, ty=%g, th=%g\n", estPose.tx, estPose.ty, estPose.th);
+
+  // 累積走行距離の計算（確認用）
+  Pose2D estMotion;                                                    // 推定移動量
+  Pose2D::calRelativePose(estPose, lastPose, estMotion);
+  atd += sqrt(estMotion.tx*estMotion.tx + estMotion.ty*estMotion.ty);
+  printf("atd=%g\n", atd);
+
+  return(successful);
+}
+
+// growMapで地図に加えた点scanGを距離場に書き込む。
+// rebuildSkipスキャンごとに局所地図から作り直して、局所地図から外れた古い点を消す。
+// 局所地図を作らない点群地図では、書き込むだけにする
+void ScanMatcherDF::updateField() {
+  if (cnt - buildCnt >= rebuildSkip && !pcmap->localMap.empty()) {
+    dfield.build(pcmap->localMap);
+    buildCnt = cnt;
+  }
+  else
+    dfield.addPoints(scanG);
+}
@@ -0,0 +1,74 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanMatcherDF.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef SCAN_MATCHER_DF_H_
+#define SCAN_MATCHER_DF_H_
+
+#include <vector>
+#include "MyUtil.h"
+#include "LPoint2D.h"
+#include "Pose2D.h"
+#include "Scan2D.h"
+#include "PointCloudMap.h"
+#include "PoseOptimizer.h"
+#include "DistanceField2D.h"
+#include "ScanMatcher2D.h"
+
+// 距離場を用いてスキャンマッチングを行う。
+// 局所地図から作った距離場の上で現在スキャンの点の垂直距離を直接最小化するので、データ対応づけをしない。
+// 距離場には、ふだんは地図に加えたスキャン点だけを書き込み、ときどき局所地図から作り直す。
+// RefScanMakerとPoseEstimatorICPは使わない。センサ融合もしない
+class ScanMatcherDF : public ScanMatcher2D
+{
+private:
+  DistanceField2D dfield;                 // 局所地図の距離場
+  PoseOptimizer *popt;                    // 距離場の上でロボット位置を最適化する
+  double dthre;                           // 使用点数を数えるときの距離閾値[m]
+  int rebuildSkip;                        // 距離場を局所地図から作り直す間隔（スキャン数）
+  int buildCnt;                           // 距離場を最後に作り直したときのスキャン番号
+  Pose2D lastEst;                         // 最後に地図に加えたロボット位置。地図が修正されたかの判定に使う
+
+public:
+  ScanMatcherDF() : popt(nullptr), dthre(0.2), rebuildSkip(50), buildCnt(0) {
+  }
+
+  ~ScanMatcherDF() {
+  }
+
+  void setPoseOptimizer(PoseOptimizer *p) {
+    popt = p;
+  }
+
+  void setDthre(double d) {
+    dthre = d;
+  }
+
+  void setRebuildSkip(int n) {
+    rebuildSkip = n;
+  }
+
+  // 格子間隔などの設定用
+  DistanceField2D &getDistanceField() {
+    return(dfield);
+  }
+
+//////////
+
+  virtual bool matchScan(Scan2D &scan);
+
+private:
+  void updateField();
+};
+
+#endif
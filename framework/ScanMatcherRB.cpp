@@ -36,13 +36,13 @@ bool ScanMatcherRB::matchScan(Scan2D &curScan) {
   // 最初のスキャンは単に地図に入れるだけ
   if (cnt == 0) {
     growMap(curScan, initPose);
-    prevScan = curScan;                      // 直前スキャンの設定
+    prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
     return(true);
   }
   
   // Scanに入っているオドメトリ値を用いて移動量を計算する
   Pose2D odoMotion;                                                   // オドメトリに基づく移動量
-  Pose2D::calRelativePose(curScan.pose, prevScan.pose, odoMotion);    // 前スキャンとの相対位置が移動量
+  Pose2D::calRelativePose(curScan.pose, prevOdom, odoMotion);         // 前スキャンとの相対位置が移動量
 
   Pose2D lastPose = pcmap->getLastPose();                        // 直前位置
   // predPoseは、ロバストコスト関数のテストでは入れない
@@ -66,7 +66,7 @@ bool ScanMatcherRB::matchScan(Scan2D &curScan) {
   cov = fusedCov;
 
   growMap(curScan, estPose);               // 地図にスキャン点群を追加
-  prevScan = curScan;                      // 直前スキャンの設定
+  prevOdom = curScan.pose;                 // 直前スキャンのオドメトリ値の設定
 
   // 確認用
 //  printf("lastPose: tx=%g, ty=%g, th=%g\n", lastPose.tx, lastPose.ty, lastPose.th);
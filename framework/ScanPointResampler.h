@@ -27,6 +27,7 @@ private:
   double dthreS;                     // 点の距離間隔[m]
   double dthreL;                     // 点の距離閾値[m]。この間隔を超えたら補間しない
   double dis;                        // 累積距離。作業用
+  std::vector<LPoint2D> newLps;      // リサンプル後の点群。作業用で、スキャンごとに使い回す
 
 public:
   ScanPointResampler() : dthreS(0.05), dthreL(0.25), dis(0) {
@@ -0,0 +1,165 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanPrefetcher.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <cstdio>
+#include <utility>
+#include "ScanPrefetcher.h"
+
+using namespace std;
+
+// 眠る前に空回りして待つ回数
+static const int SPIN_NUM = 64;
+
+//////////
+
+// 読み込みスレッドを起動する。cntは最初に読むスキャンの論理時刻
+void ScanPrefetcher::start(size_t cnt) {
+  stop();
+
+  ring.clear();
+  ring.resize(depth);
+  head.store(0);
+  tail.store(0);
+  eof.store(false);
+  stopReq.store(false);
+  readerSleeping.store(false);
+  popperSleeping.store(false);
+  popNum = occSum = occMax = emptyWaits = 0;
+  fullWaits.store(0);
+
+  reader = thread(&ScanPrefetcher::readLoop, this, cnt);
+}
+
+// 読み込みスレッドの本体。バッファに空きがある限り先読みを続ける
+void ScanPrefetcher::readLoop(size_t cnt) {
+  while (!stopReq.load(memory_order_relaxed)) {
+    size_t t = tail.load(memory_order_relaxed);
+    if (t - head.load(memory_order_acquire) >= depth) {     // 満杯なので処理スレッドを待つ
+      fullWaits.fetch_add(1, memory_order_relaxed);
+      if (!waitNotFull(t))                           // 停止要求が来た
+        break;
+    }
+
+    Scan2D &slot = ring[t%depth];                    // 処理スレッドは触らない位置
+    bool end = sreader->loadScan(cnt, slot);
+    if (end)
+      break;
+
+    ++cnt;
+    tail.store(t+1);                                 // これでslotが処理スレッドに見える
+    wakePopper();
+  }
+  eof.store(true);
+  wakePopper();
+}
+
+// バッファに空きができるまで待つ。tは読み込みスレッドが次に書き込む位置。
+// 停止要求が来たらfalseを返す
+bool ScanPrefetcher::waitNotFull(size_t t) {
+  for (int i=0; i<SPIN_NUM; i++) {                   // すぐ空くことが多いので、まず空回りして待つ
+    this_thread::yield();
+    if (t - head.load(memory_order_acquire) < depth)
+      return(true);
+    if (stopReq.load(memory_order_relaxed))
+      return(false);
+  }
+
+  // 眠る。フラグを立ててから条件を調べ直すので、処理スレッドが起こし損ねることはない
+  unique_lock<mutex> lock(mtx);
+  readerSleeping.store(true);
+  cvNotFull.wait(lock, [&] { return(t - head.load() < depth || stopReq.load()); });
+  readerSleeping.store(false);
+
+  return(!stopReq.load());
+}
+
+// スキャンが入るまで待つ。hは処理スレッドが次に取り出す位置で、tに書き込み位置を入れる。
+// ファイルが終わって、もう何も入らなければfalseを返す
+bool ScanPrefetcher::waitNotEmpty(size_t h, size_t &t) {
+  for (int i=0; i<SPIN_NUM; i++) {                   // 読み込みが追いつくまで、まず空回りして待つ
+    this_thread::yield();
+    bool end = eof.load(memory_order_acquire);       // 終端フラグを先に読み、その前に書かれた分を確認
+    t = tail.load(memory_order_acquire);
+    if (h != t)
+      return(true);
+    if (end)
+      return(false);
+  }
+
+  unique_lock<mutex> lock(mtx);
+  popperSleeping.store(true);
+  cvNotEmpty.wait(lock, [&] { return(h != tail.load() || eof.load()); });
+  popperSleeping.store(false);
+  t = tail.load();
+
+  return(h != t);
+}
+
+// 読み込みスレッドが眠っていれば起こす
+void ScanPrefetcher::wakeReader() {
+  if (readerSleeping.load()) {
+    lock_guard<mutex> lock(mtx);
+    cvNotFull.notify_one();
+  }
+}
+
+// 処理スレッドが眠っていれば起こす
+void ScanPrefetcher::wakePopper() {
+  if (popperSleeping.load()) {
+    lock_guard<mutex> lock(mtx);
+    cvNotEmpty.notify_one();
+  }
+}
+
+// 先読みしたスキャンを1個取り出す。SensorDataReader::loadScanと同じく、ファイルが終わったらtrueを返す。
+// scanの中身はリングバッファのスキャンと交換するので、点群の領域は使い回される。
+bool ScanPrefetcher::loadScan(size_t cnt, Scan2D &scan) {
+  size_t h = head.load(memory_order_relaxed);
+  size_t t = tail.load(memory_order_acquire);
+  if (h == t) {                                      // 読み込みが追いつくまで待つ
+    ++emptyWaits;
+    if (!waitNotEmpty(h, t))
+      return(true);
+  }
+
+  size_t occ = t - h;                                // 取り出し時のバッファ占有数
+  occSum += occ;
+  if (occ > occMax)
+    occMax = occ;
+  ++popNum;
+
+  swap(scan, ring[h%depth]);                         // コピーせず交換する
+  head.store(h+1);                                   // これでslotが読み込みスレッドに戻る
+  wakeReader();
+
+  return(false);
+}
+
+// 読み込みスレッドを止める
+void ScanPrefetcher::stop() {
+  stopReq.store(true);
+  {
+    lock_guard<mutex> lock(mtx);                     // 眠っている読み込みスレッドを起こす
+    cvNotFull.notify_one();
+  }
+  if (reader.joinable())
+    reader.join();
+}
+
+// バッファの使用状況を表示する（確認用）
+void ScanPrefetcher::printStats() {
+  double avg = (popNum > 0) ? 1.0*occSum/popNum : 0;
+  printf("ScanPrefetcher: depth=%zu, scans=%zu, occupancy avg=%g max=%zu, emptyWaits=%zu, fullWaits=%zu\n",
+         depth, popNum, avg, occMax, emptyWaits, fullWaits.load());
+}
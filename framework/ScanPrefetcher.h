@@ -0,0 +1,95 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file ScanPrefetcher.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef SCAN_PREFETCHER_H_
+#define SCAN_PREFETCHER_H_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Scan2D.h"
+#include "SensorDataReader.h"
+
+////////
+
+// 別スレッドでスキャンを先読みする。
+// 読み込みスレッド1個と処理スレッド1個の間を、ロックなしのリングバッファでつなぐ。
+// バッファが満杯または空のときは、少しだけ空回りして待ち、それでもだめなら条件変数で眠る。
+// 相手が眠っているときだけロックをとって起こすので、普段の受け渡しにはロックを使わない。
+class ScanPrefetcher
+{
+private:
+  SensorDataReader *sreader;             // 実際にファイルを読む
+  size_t depth;                          // リングバッファの容量（先読みするスキャン数）
+  std::vector<Scan2D> ring;              // リングバッファ本体
+
+  alignas(64) std::atomic<size_t> head;  // 次に取り出す位置。処理スレッドだけが更新
+  alignas(64) std::atomic<size_t> tail;  // 次に書き込む位置。読み込みスレッドだけが更新
+  alignas(64) std::atomic<bool> eof;     // 読み込みスレッドがファイル終端に達したか
+  std::atomic<bool> stopReq;             // 読み込みスレッドの停止要求
+  std::thread reader;                    // 読み込みスレッド
+
+  std::mutex mtx;                        // 眠るときと起こすときだけ使う
+  std::condition_variable cvNotFull;     // バッファに空きができたことを読み込みスレッドに知らせる
+  std::condition_variable cvNotEmpty;    // スキャンが入ったことを処理スレッドに知らせる
+  std::atomic<bool> readerSleeping;      // 読み込みスレッドが満杯で眠っているか
+  std::atomic<bool> popperSleeping;      // 処理スレッドが空で眠っているか
+
+  // 統計（確認用）
+  size_t popNum;                         // 取り出したスキャン数
+  size_t occSum;                         // 取り出し時のバッファ占有数の合計
+  size_t occMax;                         // 取り出し時のバッファ占有数の最大
+  size_t emptyWaits;                     // バッファが空で処理スレッドが待った回数。1回の待ちで1つ数える
+  std::atomic<size_t> fullWaits;         // バッファが満杯で読み込みスレッドが待った回数。1回の待ちで1つ数える
+
+public:
+  ScanPrefetcher() : sreader(nullptr), depth(16), head(0), tail(0), eof(false), stopReq(false), readerSleeping(false), popperSleeping(false), popNum(0), occSum(0), occMax(0), emptyWaits(0), fullWaits(0) {
+  }
+
+  ~ScanPrefetcher() {
+    stop();
+  }
+
+////////
+
+  void setSensorDataReader(SensorDataReader *r) {
+    sreader = r;
+  }
+
+  void setDepth(size_t d) {
+    depth = (d > 0) ? d : 1;
+  }
+
+  bool isRunning() const {
+    return(reader.joinable());
+  }
+
+////////
+
+  void start(size_t cnt);
+  bool loadScan(size_t cnt, Scan2D &scan);
+  void stop();
+  void printStats();
+
+private:
+  void readLoop(size_t cnt);
+  bool waitNotFull(size_t t);
+  bool waitNotEmpty(size_t h, size_t &t);
+  void wakeReader();
+  void wakePopper();
+};
+
+#endif
@@ -0,0 +1,207 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file SensorDataBinary.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "SensorDataBinary.h"
+
+using namespace std;
+
+const char SensorDataBinary::MAGIC[8] = {'L', 'S', 'B', 'S', 'C', 'A', 'N', '1'};
+
+////////
+
+// バイナリ形式スキャンログをメモリマップで開く
+bool SensorDataBinary::open(const char *filepath) {
+  close();
+
+#ifdef _WIN32
+  HANDLE hf = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hf == INVALID_HANDLE_VALUE) {
+    cerr << "Error: cannot open file " << filepath << endl;
+    return(false);
+  }
+  LARGE_INTEGER sz;
+  GetFileSizeEx(hf, &sz);
+  fsize = static_cast<size_t>(sz.QuadPart);
+  HANDLE hm = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+  const void *p = (hm != NULL) ? MapViewOfFile(hm, FILE_MAP_READ, 0, 0, 0) : NULL;
+  hFile = hf;
+  hMap = hm;
+  if (p == NULL) {
+    cerr << "Error: cannot map file " << filepath << endl;
+    close();
+    return(false);
+  }
+#else
+  int fd = ::open(filepath, O_RDONLY);
+  if (fd < 0) {
+    cerr << "Error: cannot open file " << filepath << endl;
+    return(false);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    cerr << "Error: cannot map file " << filepath << endl;
+    return(false);
+  }
+  fsize = static_cast<size_t>(st.st_size);
+  void *p = mmap(nullptr, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);                                       // マップ後はファイル記述子は不要
+  if (p == MAP_FAILED) {
+    cerr << "Error: cannot map file " << filepath << endl;
+    return(false);
+  }
+  madvise(p, fsize, MADV_SEQUENTIAL);                // 先頭から順に読むので先読みさせる
+#endif
+  data = static_cast<const char*>(p);
+
+  // ヘッダとオフセット表の検査
+  header = reinterpret_cast<const BinaryLogHeader*>(data);
+  bool valid = (fsize >= sizeof(BinaryLogHeader) && memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION);
+  valid = valid && header->indexOffset%sizeof(uint64_t) == 0 && header->indexOffset <= fsize
+                && header->scanNum <= (fsize - header->indexOffset)/sizeof(uint64_t);
+  if (valid) {
+    offsets = reinterpret_cast<const uint64_t*>(data + header->indexOffset);
+    for (size_t i=0; valid && i<header->scanNum; i++) {
+      uint64_t off = offsets[i];
+      valid = off%sizeof(double) == 0 && off + sizeof(BinaryScanRecord) <= header->indexOffset;
+      if (valid) {
+        const BinaryScanRecord *rec = reinterpret_cast<const BinaryScanRecord*>(data + off);
+        valid = rec->pnum <= (header->indexOffset - off - sizeof(BinaryScanRecord))/(2*sizeof(float));
+      }
+    }
+  }
+  if (!valid) {
+    cerr << "Error: broken binary scan log " << filepath << endl;
+    close();
+    return(false);
+  }
+
+  return(true);
+}
+
+void SensorDataBinary::close() {
+#ifdef _WIN32
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (hMap != nullptr)
+    CloseHandle(static_cast<HANDLE>(hMap));
+  if (hFile != nullptr)
+    CloseHandle(static_cast<HANDLE>(hFile));
+  hFile = hMap = nullptr;
+#else
+  if (data != nullptr)
+    munmap(const_cast<char*>(data), fsize);
+#endif
+  data = nullptr;
+  fsize = 0;
+  header = nullptr;
+  offsets = nullptr;
+}
+
+////////
+
+// ファイルがバイナリ形式スキャンログかどうか。先頭の識別子で判定する
+bool SensorDataBinary::isBinaryFile(const char *filepath) {
+  ifstream ifs(filepath, ios::binary);
+  char magic[sizeof(MAGIC)];
+  if (!ifs.read(magic, sizeof(magic)))
+    return(false);
+
+  return(memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+}
+
+// テキスト形式のログtextPathをバイナリ形式に変換してbinPathに書く
+bool SensorDataBinary::convertTextLog(const char *textPath, const char *binPath) {
+  ifstream inFile(textPath);
+  if (!inFile.is_open()) {
+    cerr << "Error: cannot open file " << textPath << endl;
+    return(false);
+  }
+  ofstream outFile(binPath, ios::binary);
+  if (!outFile.is_open()) {
+    cerr << "Error: cannot open file " << binPath << endl;
+    return(false);
+  }
+
+  BinaryLogHeader header;                      // スキャン数などは最後に書き直す
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  vector<uint64_t> offsets;                    // 各スキャンレコードの位置
+  vector<float> buf;                           // angle列とrange列
+  uint64_t pos = sizeof(header);               // 現在の書き込み位置
+  string type;
+  while (inFile >> type) {
+    if (type != "LASERSCAN") {                 // スキャン以外は読み飛ばす
+      string line;
+      getline(inFile, line);
+      continue;
+    }
+
+    BinaryScanRecord rec;
+    int pnum;
+    inFile >> rec.sid >> rec.sec >> rec.nsec >> pnum;
+    if (!inFile || pnum < 0)
+      break;
+    rec.pnum = static_cast<uint32_t>(pnum);
+    buf.resize(2*rec.pnum);
+    for (uint32_t i=0; i<rec.pnum; i++)
+      inFile >> buf[i] >> buf[rec.pnum + i];   // スキャン点の方位と距離
+    inFile >> rec.tx >> rec.ty >> rec.th;      // オドメトリ値
+    if (!inFile)                               // 途中で切れたスキャンは捨てる
+      break;
+
+    offsets.push_back(pos);
+    outFile.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    outFile.write(reinterpret_cast<const char*>(buf.data()), buf.size()*sizeof(float));
+    pos += sizeof(rec) + buf.size()*sizeof(float);
+    if (pos%sizeof(double) != 0) {             // 次のレコードを8バイト境界に揃える
+      const char pad[sizeof(double)] = {0};
+      size_t pn = sizeof(double) - pos%sizeof(double);
+      outFile.write(pad, pn);
+      pos += pn;
+    }
+  }
+
+  // オフセット表を書いて、ヘッダを完成させる
+  header.scanNum = offsets.size();
+  header.indexOffset = pos;
+  outFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size()*sizeof(uint64_t));
+  outFile.seekp(0);
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if (!outFile) {
+    cerr << "Error: cannot write file " << binPath << endl;
+    return(false);
+  }
+
+  printf("SensorDataBinary: %zu scans converted\n", offsets.size());
+  return(true);
+}
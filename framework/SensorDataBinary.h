@@ -0,0 +1,105 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file SensorDataBinary.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef SENSOR_DATA_BINARY_H_
+#define SENSOR_DATA_BINARY_H_
+
+#include <cstdint>
+#include <cstddef>
+
+////////
+
+// バイナリ形式スキャンログのファイル構成
+//   [BinaryLogHeader] [スキャンレコード]*scanNum [オフセット表 uint64_t*scanNum]
+// スキャンレコードは [BinaryScanRecord] [angle float*pnum] [range float*pnum] で、8バイト境界に揃える。
+// 数値はすべて書き込んだ計算機のバイト順（通常はリトルエンディアン）。
+
+struct BinaryLogHeader
+{
+  char magic[8];                 // 識別子 "LSBSCAN1"
+  uint32_t version;              // 形式のバージョン
+  uint32_t reserved;
+  uint64_t scanNum;              // スキャン数
+  uint64_t indexOffset;          // オフセット表の位置（ファイル先頭からのバイト数）
+};
+
+struct BinaryScanRecord
+{
+  int32_t sid;                   // ログ内のスキャン番号
+  int32_t sec;                   // タイムスタンプ
+  int32_t nsec;
+  uint32_t pnum;                 // スキャン点数
+  double tx;                     // オドメトリ値。角度はラジアン
+  double ty;
+  double th;
+};
+
+////////
+
+// メモリマップしたバイナリ形式スキャンログ
+class SensorDataBinary
+{
+private:
+  const char *data;              // マップした領域の先頭
+  size_t fsize;                  // ファイルサイズ
+  const BinaryLogHeader *header;
+  const uint64_t *offsets;       // 各スキャンレコードの位置
+#ifdef _WIN32
+  void *hFile;                   // ファイルハンドル
+  void *hMap;                    // マッピングハンドル
+#endif
+
+public:
+  static const char MAGIC[8];
+  static const uint32_t VERSION=1;
+
+  SensorDataBinary() : data(nullptr), fsize(0), header(nullptr), offsets(nullptr) {
+#ifdef _WIN32
+    hFile = nullptr;
+    hMap = nullptr;
+#endif
+  }
+
+  ~SensorDataBinary() {
+    close();
+  }
+
+////////
+
+  bool isOpen() const {
+    return(data != nullptr);
+  }
+
+  size_t getScanNum() const {
+    return(header == nullptr ? 0 : static_cast<size_t>(header->scanNum));
+  }
+
+  // n番目のスキャンレコードを返す。anglesとrangesはマップ領域を直接指す
+  const BinaryScanRecord *getRecord(size_t n, const float *&angles, const float *&ranges) const {
+    const BinaryScanRecord *rec = reinterpret_cast<const BinaryScanRecord*>(data + offsets[n]);
+    angles = reinterpret_cast<const float*>(rec + 1);
+    ranges = angles + rec->pnum;
+    return(rec);
+  }
+
+////////
+
+  bool open(const char *filepath);
+  void close();
+
+  static bool isBinaryFile(const char *filepath);
+  static bool convertTextLog(const char *textPath, const char *binPath);
+};
+
+#endif
@@ -12,12 +12,21 @@
  * @author Masahiro Tomono
  ****************************************************************************/
 
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
 #include "SensorDataReader.h"
 
 using namespace std;
 
+const char SensorDataReader::INDEX_MAGIC[8] = {'L', 'S', 'S', 'C', 'I', 'D', 'X', '1'};
+
 // ファイルからスキャンを1個読む
 bool SensorDataReader::loadScan(size_t cnt, Scan2D &scan) {
+  if (binary)                            // バイナリ形式は1レコードが1スキャン
+    return(!loadBinaryScan(cnt, scan));
+
   bool isScan=false;
   while (!inFile.eof() && !isScan) {     // スキャンを読むまで続ける
     isScan = loadLaserScan(cnt, scan);
@@ -31,6 +40,29 @@ bool SensorDataReader::loadScan(size_t cnt, Scan2D &scan) {
 
 //////////////
 
+// 文字列pから数値を1個読み、pを読んだ次の位置に進める。
+// istreamの>>は数値ごとに作業用の文字列を確保することがあるので、行を読んでから自分で変換する
+static int nextInt(const char *&p) {
+  char *e;
+  long v = strtol(p, &e, 10);
+  p = e;
+  return(static_cast<int>(v));
+}
+
+static float nextFloat(const char *&p) {
+  char *e;
+  float v = strtof(p, &e);
+  p = e;
+  return(v);
+}
+
+static double nextDouble(const char *&p) {
+  char *e;
+  double v = strtod(p, &e);
+  p = e;
+  return(v);
+}
+
 // ファイルから項目1個を読む。読んだ項目がスキャンならtrueを返す。
 bool SensorDataReader::loadLaserScan(size_t cnt, Scan2D &scan) {
   string type;                           // ファイル内の項目ラベル
@@ -38,43 +70,201 @@ bool SensorDataReader::loadLaserScan(size_t cnt, Scan2D &scan) {
   if (type == "LASERSCAN") {             // スキャンの場合
     scan.setSid(static_cast<int>(cnt));
 
-    int sid, sec, nsec;
-    inFile >> sid >> sec >> nsec;        // これらは使わない
+    getline(inFile, lineBuf);            // 項目の残りは1行。lineBufの領域は使い回す
+    const char *p = lineBuf.c_str();
 
-    vector<LPoint2D> lps;
-    int pnum;                            // スキャン点数
-    inFile >> pnum;
-    lps.reserve(pnum);
+    nextInt(p);                          // sid, sec, nsecは使わない
+    nextInt(p);
+    nextInt(p);
+
+    vector<LPoint2D> &lps = scan.lps;    // scanの点群に直接書く。前のスキャンの領域を使い回す
+    lps.clear();
+    int pnum = nextInt(p);               // スキャン点数
+    if (pnum < 0)
+      pnum = 0;
+    angleBuf.resize(pnum);
+    rangeBuf.resize(pnum);
     for (int i=0; i<pnum; i++) {
-      float angle, range;
-      inFile >> angle >> range;          // スキャン点の方位と距離
-      angle += angleOffset;              // レーザスキャナの方向オフセットを考慮
-      if (range <= Scan2D::MIN_SCAN_RANGE || range >= Scan2D::MAX_SCAN_RANGE) {
-//      if (range <= Scan2D::MIN_SCAN_RANGE || range >= 3.5) {         // わざと退化を起こしやすく
-        continue;
-      }
-
-      LPoint2D lp;
-      lp.setSid(static_cast<int>(cnt));  // スキャン番号はcnt（通し番号）にする
-      lp.calXY(range, angle);            // angle,rangeから点の位置xyを計算
-      lps.emplace_back(lp);
+      angleBuf[i] = nextFloat(p);        // スキャン点の方位と距離
+      rangeBuf[i] = nextFloat(p);
     }
-    scan.setLps(lps);
+
+    // 方位の表を使って、angle,rangeから点の位置xyを計算する。範囲外の距離値は除外する
+    // スキャン番号はcnt（通し番号）にする
+    angleTable.update(angleBuf.data(), pnum, angleOffset);
+    lps.reserve(pnum);
+    angleTable.convert(rangeBuf.data(), pnum, static_cast<int>(cnt), Scan2D::MIN_SCAN_RANGE, Scan2D::MAX_SCAN_RANGE, lps);
+//    angleTable.convert(rangeBuf.data(), pnum, static_cast<int>(cnt), Scan2D::MIN_SCAN_RANGE, 3.5, lps);   // わざと退化を起こしやすく
 
     // スキャンに対応するオドメトリ情報
     Pose2D &pose = scan.pose;
-    inFile >> pose.tx >> pose.ty;
-    double th;
-    inFile >> th;
+    pose.tx = nextDouble(p);
+    pose.ty = nextDouble(p);
+    double th = nextDouble(p);
     pose.setAngle(RAD2DEG(th));          // オドメトリ角度はラジアンなので度にする
     pose.calRmat();
 
     return(true);
   }
   else {                                 // スキャン以外の場合
-    string line;
-    getline(inFile, line);               // 読み飛ばす
+    getline(inFile, lineBuf);            // 読み飛ばす
 
     return(false);
   }
 }
+
+//////////////
+
+// バイナリ形式のファイルからスキャンを1個読む。ファイルが終わっていればfalseを返す。
+bool SensorDataReader::loadBinaryScan(size_t cnt, Scan2D &scan) {
+  if (binIdx >= binFile.getScanNum())
+    return(false);
+
+  const float *angles, *ranges;          // マップ領域を直接参照するので、字句解析は不要
+  const BinaryScanRecord *rec = binFile.getRecord(binIdx, angles, ranges);
+  ++binIdx;
+
+  scan.setSid(static_cast<int>(cnt));
+
+  vector<LPoint2D> &lps = scan.lps;      // scanの点群に直接書く。前のスキャンの領域を使い回す
+  lps.clear();
+  lps.reserve(rec->pnum);
+  angleTable.update(angles, rec->pnum, angleOffset);      // 方位の並びが同じなら表はそのまま
+  angleTable.convert(ranges, rec->pnum, static_cast<int>(cnt), Scan2D::MIN_SCAN_RANGE, Scan2D::MAX_SCAN_RANGE, lps);
+
+  // スキャンに対応するオドメトリ情報
+  Pose2D &pose = scan.pose;
+  pose.tx = rec->tx;
+  pose.ty = rec->ty;
+  pose.setAngle(RAD2DEG(rec->th));       // オドメトリ角度はラジアンなので度にする
+  pose.calRmat();
+
+  return(true);
+}
+
+//////////////
+
+// ファイル内のスキャン数
+size_t SensorDataReader::getScanNum() {
+  if (binary)
+    return(binFile.getScanNum());
+
+  if (!indexed)
+    makeScanIndex();
+  return(scanOffsets.size());
+}
+
+// n番目のスキャンの直前に移動する。次のloadScanでn番目のスキャンが読まれる。
+// nがスキャン数以上ならファイル末尾に移動してfalseを返す。
+bool SensorDataReader::seekScan(size_t n) {
+  if (binary) {                          // バイナリ形式はオフセット表を持っている
+    binIdx = min(n, binFile.getScanNum());
+    return(n < binFile.getScanNum());
+  }
+
+  if (!indexed && !makeScanIndex())
+    return(false);
+
+  inFile.clear();                        // eofフラグが立っていても移動できるように
+  if (n >= scanOffsets.size()) {
+    inFile.seekg(0, ios::end);
+    return(false);
+  }
+  inFile.seekg(static_cast<streamoff>(scanOffsets[n]));
+  return(!inFile.fail());
+}
+
+// n番目からnum個のスキャンをscansに読む。読んだスキャン数を返す。
+// スキャン番号（論理時刻）はファイル内の通し番号にする。
+size_t SensorDataReader::loadScans(size_t n, size_t num, vector<Scan2D> &scans) {
+  scans.clear();
+  if (!seekScan(n))
+    return(0);
+
+  scans.reserve(num);
+  for (size_t i=0; i<num; i++) {
+    Scan2D scan;
+    if (loadScan(n+i, scan))             // ファイルが終わった
+      break;
+    scans.emplace_back(move(scan));
+  }
+
+  return(scans.size());
+}
+
+//////////////
+
+// テキスト形式のファイルについて、各スキャンの位置の索引を作る。
+// 索引はデータファイル名.idxに保存しておき、次回からはそれを読む。
+bool SensorDataReader::makeScanIndex() {
+  scanOffsets.clear();
+  indexed = false;
+
+  ifstream ifs(filename, ios::binary);
+  if (!ifs.is_open()) {
+    cerr << "Error: cannot open file " << filename << endl;
+    return(false);
+  }
+  ifs.seekg(0, ios::end);
+  uint64_t fsize = static_cast<uint64_t>(ifs.tellg());   // 索引が古くないかをファイルサイズで確認する
+  ifs.seekg(0, ios::beg);
+
+  string idxPath = filename + ".idx";
+  if (readIndexFile(idxPath, fsize)) {
+    indexed = true;
+    return(true);
+  }
+
+  // 行頭がLASERSCANの行の位置を記録する
+  const char *label = "LASERSCAN";
+  size_t llen = strlen(label);
+  uint64_t pos = 0;                      // 行頭の位置
+  string line;
+  while (getline(ifs, line)) {
+    if (line.compare(0, llen, label) == 0)
+      scanOffsets.push_back(pos);
+    pos += line.size() + 1;              // 改行文字の分も進める
+  }
+  indexed = true;
+
+  writeIndexFile(idxPath, fsize);
+  printf("SensorDataReader: scan index made, %zu scans\n", scanOffsets.size());
+
+  return(true);
+}
+
+// 索引ファイルを読む。データファイルと合わない場合はfalseを返す。
+bool SensorDataReader::readIndexFile(const string &idxPath, uint64_t fsize) {
+  ifstream ifs(idxPath, ios::binary);
+  if (!ifs.is_open())
+    return(false);
+
+  char magic[sizeof(INDEX_MAGIC)];
+  uint64_t size, num;
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char*>(&size), sizeof(size));
+  ifs.read(reinterpret_cast<char*>(&num), sizeof(num));
+  if (!ifs || memcmp(magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || size != fsize || num > fsize)
+    return(false);
+
+  scanOffsets.resize(num);
+  ifs.read(reinterpret_cast<char*>(scanOffsets.data()), num*sizeof(uint64_t));
+  if (!ifs) {
+    scanOffsets.clear();
+    return(false);
+  }
+
+  return(true);
+}
+
+// 索引ファイルを書く。書けなくても索引はメモリ上にあるので、警告だけ出す。
+void SensorDataReader::writeIndexFile(const string &idxPath, uint64_t fsize) {
+  ofstream ofs(idxPath, ios::binary);
+  uint64_t num = scanOffsets.size();
+  ofs.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  ofs.write(reinterpret_cast<const char*>(&fsize), sizeof(fsize));
+  ofs.write(reinterpret_cast<const char*>(&num), sizeof(num));
+  ofs.write(reinterpret_cast<const char*>(scanOffsets.data()), num*sizeof(uint64_t));
+  if (!ofs)
+    cerr << "Warning: cannot write index file " << idxPath << endl;
+}
@@ -18,10 +18,14 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <string>
+#include <cstdint>
 #include "MyUtil.h"
 #include "LPoint2D.h"
 #include "Pose2D.h"
 #include "Scan2D.h"
+#include "SensorDataBinary.h"
+#include "ScanAngleTable.h"
 
 /////////
 
@@ -30,9 +34,21 @@ class SensorDataReader
 private:
   int angleOffset;                      // レーザスキャナとロボットの向きのオフセット
   std::ifstream inFile;                 // データファイル
+  SensorDataBinary binFile;             // バイナリ形式のデータファイル
+  bool binary;                          // バイナリ形式か
+  size_t binIdx;                        // バイナリ形式で次に読むスキャンの位置
+  std::string filename;                 // データファイル名
+  std::vector<uint64_t> scanOffsets;    // テキスト形式での各スキャンの位置。必要になったら作る
+  bool indexed;                         // scanOffsetsができているか
+  ScanAngleTable angleTable;            // 方位ごとのcos, sinの表。方位の並びが変わったら作り直す
+  std::vector<float> angleBuf;          // テキスト形式で読んだ方位。作業用
+  std::vector<float> rangeBuf;          // テキスト形式で読んだ距離。作業用
+  std::string lineBuf;                  // テキスト形式で読んだ1行。作業用
 
 public:
-  SensorDataReader() : angleOffset(180) {
+  static const char INDEX_MAGIC[8];     // 索引ファイルの識別子
+
+  SensorDataReader() : angleOffset(180), binary(false), binIdx(0), indexed(false) {
   }
 
   ~SensorDataReader() {
@@ -41,6 +57,15 @@ public:
 ////////
 
   bool openScanFile(const char *filepath) {
+    filename = filepath;
+    scanOffsets.clear();
+    indexed = false;
+    binary = SensorDataBinary::isBinaryFile(filepath);   // 先頭の識別子で形式を判定
+    if (binary) {
+      binIdx = 0;
+      return(binFile.open(filepath));
+    }
+
     inFile.open(filepath);
     if (!inFile.is_open()) {
       std::cerr << "Error: cannot open file " << filepath << std::endl;
@@ -51,7 +76,10 @@ public:
   }
 
   void closeScanFile() {
-    inFile.close();
+    if (binary)
+      binFile.close();
+    else
+      inFile.close();
   }
 
   void setAngleOffset(int o) {
@@ -62,6 +90,16 @@ public:
 
   bool loadScan(size_t cnt, Scan2D &scan);
   bool loadLaserScan(size_t cnt, Scan2D &scan);
+  bool loadBinaryScan(size_t cnt, Scan2D &scan);
+
+  size_t getScanNum();
+  bool seekScan(size_t n);
+  size_t loadScans(size_t n, size_t num, std::vector<Scan2D> &scans);
+
+private:
+  bool makeScanIndex();
+  bool readIndexFile(const std::string &idxPath, uint64_t fsize);
+  void writeIndexFile(const std::string &idxPath, uint64_t fsize);
 };
 
 #endif
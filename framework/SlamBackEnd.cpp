@@ -28,8 +28,28 @@ Pose2D SlamBackEnd::adjustPoses() {
 
 /////////////////////////////
 
-void SlamBackEnd::remakeMaps() {
-  // PoseGraphの修正
+// 別スレッドでポーズ調整した姿勢posesを、remakeMapsで使うように設定する。
+// posesはポーズ調整を始めた時点のノードの分しかないので、その後に追加されたノードは
+// 最後の調整済みノードとの相対位置を保ったまま動かす
+void SlamBackEnd::setNewPoses(const vector<Pose2D> &poses) {
+  newPoses = poses;
+  vector<PoseNode*> &pnodes = pg->nodes;      // ポーズノード
+  size_t m = poses.size();
+  if (m == 0 || m > pnodes.size())            // 念のためのチェック
+    return;
+
+  const Pose2D &oldBase = pnodes[m-1]->pose;  // 最後の調整済みノードの調整前の位置
+  const Pose2D &newBase = poses[m-1];         // その調整後の位置
+  for (size_t i=m; i<pnodes.size(); i++) {
+    Pose2D relPose, npose;
+    Pose2D::calRelativePose(pnodes[i]->pose, oldBase, relPose);
+    Pose2D::calGlobalPose(relPose, newBase, npose);
+    newPoses.emplace_back(npose);
+  }
+}
+
+// PoseGraphの修正
+void SlamBackEnd::updateNodes() {
   vector<PoseNode*> &pnodes = pg->nodes;      // ポーズノード
   for (size_t i=0; i<newPoses.size(); i++) {
     Pose2D &npose = newPoses[i];
@@ -37,6 +57,11 @@ void SlamBackEnd::remakeMaps() {
     pnode->setPose(npose);                    // 各ノードの位置を更新
   }
   printf("newPoses.size=%zu, nodes.size=%zu\n", newPoses.size(), pnodes.size());
+}
+
+void SlamBackEnd::remakeMaps() {
+  // PoseGraphの修正
+  updateNodes();
 
   // PointCloudMapの修正
   pcmap->remakeMaps(newPoses);
@@ -58,9 +58,18 @@ public:
     p2o.setBeRobust(t);
   }
   
+//////////
+
+  // ポーズ調整後の姿勢。別スレッドでポーズ調整したときに、結果を取り出すのに使う
+  const std::vector<Pose2D> &getNewPoses() const {
+    return(newPoses);
+  }
+
 //////////
 
   Pose2D adjustPoses();
+  void setNewPoses(const std::vector<Pose2D> &poses);
+  void updateNodes();
   void remakeMaps(); 
 };
 
@@ -23,6 +23,8 @@ void SlamFrontEnd::init() {
   smat->reset();
   smat->setPointCloudMap(pcmap);
   sback.setPointCloudMap(pcmap);
+  if (async)
+    aback.start(lpd, sback);                      // ループ閉じ込みの作業スレッドを起動
 }
 
 ///////////
@@ -32,6 +34,13 @@ void SlamFrontEnd::process(Scan2D &scan) {
   if (cnt == 0) 
     init();                                       // 開始時に初期化
 
+  // 別スレッドのループ閉じ込みの結果が出ていたら、スキャンマッチングの前に地図を修正する。
+  // 作業スレッドが空いたら、保留中のキーフレームを渡す
+  if (async) {
+    applyBackEndResult();
+    aback.submitPending(pg);
+  }
+
   // スキャンマッチング
   smat->matchScan(scan);
 
@@ -56,10 +65,14 @@ void SlamFrontEnd::process(Scan2D &scan) {
 
   // ループ閉じ込み
   if (cnt > keyframeSkip && cnt%keyframeSkip==0) {       // キーフレームのときだけ行う
-    bool flag = lpd->detectLoop(&scan, curPose, cnt);    // ループ検出を起動
-    if (flag) {
-      sback.adjustPoses();                               // ループが見つかったらポーズ調整
-      sback.remakeMaps();                                // 地図やポーズグラフの修正
+    if (async)
+      aback.submit(scan, curPose, cnt, pg);              // 作業スレッドに渡して、結果は待たない。作業中なら保留する
+    else {
+      bool flag = lpd->detectLoop(&scan, curPose, cnt);  // ループ検出を起動
+      if (flag) {
+        sback.adjustPoses();                             // ループが見つかったらポーズ調整
+        sback.remakeMaps();                              // 地図やポーズグラフの修正
+      }
     }
   }
 
@@ -70,6 +83,37 @@ void SlamFrontEnd::process(Scan2D &scan) {
   ++cnt;
 }
 
+// 処理の終わりに呼ぶ。別スレッドのループ閉じ込みが終わるのを待って、その結果を地図に反映する。
+// 保留中のキーフレームがあれば、それも処理する
+void SlamFrontEnd::finish() {
+  if (!aback.isRunning())
+    return;
+
+  do {
+    aback.waitIdle();
+    applyBackEndResult();
+  } while (aback.submitPending(pg));
+  aback.stop();
+  aback.printStats();
+  countLoopArcs();            // 確認用
+}
+
+// 別スレッドのループ閉じ込みの結果があれば、ループアークを張って地図とポーズグラフを修正する。
+// 結果は仕事を渡した時点のノードの分しかないので、その後のノードはsback.setNewPosesで合わせて動かす
+bool SlamFrontEnd::applyBackEndResult() {
+  vector<Pose2D> poses;
+  vector<PoseArc> arcs;
+  if (!aback.fetchResult(poses, arcs))
+    return(false);
+
+  for (size_t i=0; i<arcs.size(); i++)
+    pg->addArc(pg->copyArc(arcs[i]));                    // ループアークを登録
+  sback.setNewPoses(poses);                              // ポーズ調整の結果を設定
+  sback.remakeMaps();                                    // 地図やポーズグラフの修正
+
+  return(true);
+}
+
 ////////////
 
 // オドメトリアークの生成
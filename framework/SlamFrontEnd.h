@@ -21,6 +21,7 @@
 #include "PoseGraph.h"
 #include "LoopDetector.h"
 #include "SlamBackEnd.h"
+#include "AsyncBackEnd.h"
 
 ////////
 
@@ -36,14 +37,17 @@ private:
   ScanMatcher2D *smat;                   // スキャンマッチング
   LoopDetector *lpd;                     // ループ検出器
   SlamBackEnd sback;                     // SLAMバックエンド
+  AsyncBackEnd aback;                    // 別スレッドでループ閉じ込みを行うバックエンド
+  bool async;                            // ループ閉じ込みを別スレッドで行うか
 
 public:
-  SlamFrontEnd()  : cnt(0), keyframeSkip(10), pcmap(nullptr), smat(nullptr), lpd(nullptr) {
+  SlamFrontEnd()  : cnt(0), keyframeSkip(10), pcmap(nullptr), smat(nullptr), lpd(nullptr), async(false) {
     pg = new PoseGraph();
     sback.setPoseGraph(pg);
   }
 
   ~SlamFrontEnd() {
+    aback.stop();                        // 作業スレッドを先に止める
     delete pg;
   }
 
@@ -82,6 +86,15 @@ public:
     smat->setDgCheck(p);
   }
 
+  // ループ検出とポーズ調整を別スレッドで行うか。処理を始める前に設定する
+  void setAsyncBackEnd(bool t) {
+    async = t;
+  }
+
+  bool getAsyncBackEnd() {
+    return(async);
+  }
+
   // デバッグ用
   std::vector<LoopMatch> &getLoopMatches() {
     return(lpd->getLoopMatches());
@@ -100,7 +113,9 @@ public:
 
   void init();
   void process(Scan2D &scan);
+  void finish();
   bool makeOdometryArc(Pose2D &curPose, const Eigen::Matrix3d &cov);
+  bool applyBackEndResult();
 
   void countLoopArcs();
 };
@@ -0,0 +1,91 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file WorkerPool.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include "WorkerPool.h"
+
+using namespace std;
+
+//////////
+
+// 呼び出しスレッドを含めてnスレッドで実行するようにする。1以下なら並列にしない
+void WorkerPool::setThreadNum(size_t n) {
+  stop();
+  stopReq = false;
+  for (size_t i=1; i<n; i++)
+    threads.emplace_back(&WorkerPool::workLoop, this, generation);     // 起動時の世代を渡す
+}
+
+// 仕事f(0), ..., f(n-1)を並列に実行し、すべて終わるまで待つ。
+// 仕事を取る順序は決まらないので、fは自分の番号の結果だけを書くこと。
+void WorkerPool::run(size_t n, const function<void(size_t)> &f) {
+  if (threads.empty()) {                         // 並列にしない
+    for (size_t k=0; k<n; k++)
+      f(k);
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(mtx);
+    job = &f;
+    jobNum = n;
+    nextJob.store(0);
+    activeNum = threads.size();
+    ++generation;
+  }
+  cvStart.notify_all();
+
+  for (size_t k=nextJob++; k<n; k=nextJob++)     // 呼び出しスレッドも仕事をする
+    f(k);
+
+  unique_lock<mutex> lock(mtx);
+  cvDone.wait(lock, [this] { return(activeNum == 0); });
+  job = nullptr;
+}
+
+// 作業スレッドの本体。新しい仕事が来るたびに、残っている仕事を取って実行する。
+// genは最後に実行した世代。スレッドが動き出す前にrunが呼ばれても、その仕事を取りこぼさない
+void WorkerPool::workLoop(size_t gen) {
+  while (true) {
+    const function<void(size_t)> *f;
+    size_t n;
+    {
+      unique_lock<mutex> lock(mtx);
+      cvStart.wait(lock, [this, gen] { return(stopReq || generation != gen); });
+      if (stopReq)
+        return;
+      gen = generation;
+      f = job;
+      n = jobNum;
+    }
+
+    for (size_t k=nextJob++; k<n; k=nextJob++)
+      (*f)(k);
+
+    lock_guard<mutex> lock(mtx);
+    if (--activeNum == 0)
+      cvDone.notify_one();
+  }
+}
+
+// 作業スレッドを止める
+void WorkerPool::stop() {
+  {
+    lock_guard<mutex> lock(mtx);
+    stopReq = true;
+  }
+  cvStart.notify_all();
+  for (size_t i=0; i<threads.size(); i++)
+    threads[i].join();
+  threads.clear();
+}
@@ -0,0 +1,67 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file WorkerPool.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+////////
+
+// 作業スレッドを起動したままにしておき、仕事を番号ごとに分けて並列に実行する。
+// 呼び出しのたびにスレッドを作ると、対応づけのような短い処理では起動時間のほうが長くなるため。
+class WorkerPool
+{
+private:
+  std::vector<std::thread> threads;      // 作業スレッド。呼び出しスレッドは含まない
+  std::mutex mtx;
+  std::condition_variable cvStart;       // 仕事の開始を作業スレッドに知らせる
+  std::condition_variable cvDone;        // 作業スレッドの終了を呼び出しスレッドに知らせる
+
+  const std::function<void(size_t)> *job;    // 実行する仕事。引数は仕事の番号
+  size_t jobNum;                         // 仕事の数
+  std::atomic<size_t> nextJob;           // 次に取る仕事の番号
+  size_t activeNum;                      // まだ終わっていない作業スレッドの数
+  size_t generation;                     // runの呼び出し回数。新しい仕事の目印
+  bool stopReq;                          // 作業スレッドの停止要求
+
+public:
+  WorkerPool() : job(nullptr), jobNum(0), nextJob(0), activeNum(0), generation(0), stopReq(false) {
+  }
+
+  ~WorkerPool() {
+    stop();
+  }
+
+  // 呼び出しスレッドを含めたスレッド数
+  size_t getThreadNum() const {
+    return(threads.size() + 1);
+  }
+
+////////
+
+  void setThreadNum(size_t n);
+  void run(size_t n, const std::function<void(size_t)> &f);
+
+private:
+  void workLoop(size_t gen);
+  void stop();
+};
+
+#endif
@@ -26,6 +26,10 @@ public:
   ~CostFunctionED() {
   }
 
+  virtual CostFunction *clone() const {
+    return(new CostFunctionED(*this));
+  }
+
   virtual double calValue(double tx, double ty, double th);
 };
 
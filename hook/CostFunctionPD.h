@@ -26,6 +26,10 @@ public:
   ~CostFunctionPD() {
   }
 
+  virtual CostFunction *clone() const {
+    return(new CostFunctionPD(*this));
+  }
+
   virtual double calValue(double tx, double ty, double th);
 };
 
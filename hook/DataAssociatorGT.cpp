@@ -21,21 +21,13 @@ using namespace std;
 double DataAssociatorGT::findCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
   chrono_time t0 = clock();  
 
-  curLps.clear();                                   // 対応づけ現在スキャン点群を空にする
-  refLps.clear();                                   // 対応づけ参照スキャン点群を空にする
-
-  nntab.setDthre(dthre);
-
-  for (size_t i=0; i<curScan->lps.size(); i++) {
-    const LPoint2D *clp = &(curScan->lps[i]);       // 現在スキャンの点。ポインタで。
-
-    // 格子テーブルにより最近傍点を求める。格子テーブル内に距離閾値dthreがあることに注意。
-    const LPoint2D *rlp = nntab.findClosestPoint(clp, predPose);
- 
-    if (rlp != nullptr) {
-      curLps.push_back(clp);                        // 最近傍点があれば登録
-      refLps.push_back(rlp);
-    }
+  if (!reuseCorrespondence(curScan, predPose)) {   // 前回の対応を使い回せなければ探す
+    // 格子テーブルにより、現在スキャンの全点について距離閾値dthre内の最近傍点をまとめて求める。
+    // 結果はcurLpsとrefLpsに入る。スレッド数が2以上なら点をブロックに分けて並列に求める
+    associateBlocks(curScan->lps.size(), [&](size_t i0, size_t i1, vector<const LPoint2D*> &cur, vector<const LPoint2D*> &ref) {
+      nntab.findClosestPoints(curScan, i0, i1, predPose, dthre, cur, ref);
+    });
+    saveCorrespondence(curScan, predPose);
   }
 
   double ratio = (1.0*curLps.size())/curScan->lps.size();         // 対応がとれた点の比率
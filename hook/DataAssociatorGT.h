@@ -16,13 +16,13 @@
 #define DATA_ASSOCIATOR_GT_H_
 
 #include "DataAssociator.h"
-#include "NNGridTable.h"
+#include "NNGridFrozen.h"
 
 // 格子テーブルを用いて、現在スキャンと参照スキャン間の点の対応づけを行う
 class DataAssociatorGT : public DataAssociator
 {
 private:
-  NNGridTable nntab;                        // 格子テーブル
+  NNGridFrozen nntab;                       // 参照スキャンの格子テーブル
   
 public:
   DataAssociatorGT() {
@@ -31,11 +31,16 @@ public:
   ~DataAssociatorGT() {
   }
   
-  // 参照スキャンの点rlpsをポインタにしてnntabに入れる
+  // 参照スキャンの点rlpsからnntabを作る。セルサイズは距離閾値の半分にする
   virtual void setRefBase(const std::vector<LPoint2D> &rlps) {
-    nntab.clear();
-    for (size_t i=0; i<rlps.size(); i++) 
-      nntab.addPoint(&rlps[i]);              // ポインタにして格納
+    nntab.build(rlps, dthre/2);
+    clearReuse();
+  }
+
+  virtual DataAssociator *clone() const {
+    DataAssociatorGT *d = new DataAssociatorGT();
+    d->copySettings(*this);
+    return(d);
   }
 
 /////////
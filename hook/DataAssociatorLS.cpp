@@ -20,29 +20,33 @@ using namespace std;
 double DataAssociatorLS::findCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
   chrono_time t0 = clock();  
 
-  curLps.clear();                                   // 対応づけ現在スキャン点群を空にする
-  refLps.clear();                                   // 対応づけ参照スキャン点群を空にする
-  for (size_t i=0; i<curScan->lps.size(); i++) {
-    const LPoint2D *clp = &(curScan->lps[i]);       // 現在スキャンの点。ポインタで。
-
-    // スキャン点lpをpredPoseで座標変換した位置に最も近い点を見つける
-    LPoint2D glp;                                   // clpの予測位置
-    predPose.globalPoint(*clp, glp);                // predPoseで座標変換
-
-    double dmin = HUGE_VAL;                         // 距離最小値
-    const LPoint2D *rlpmin = nullptr;               // 最も近い点
-    for (size_t j=0; j<baseLps.size(); j++) {
-      const LPoint2D *rlp = baseLps[j];             // 参照スキャン点
-      double d = (glp.x - rlp->x)*(glp.x - rlp->x) + (glp.y - rlp->y)*(glp.y - rlp->y);
-      if (d <= dthre*dthre && d < dmin) {           // dthre内で距離が最小となる点を保存
-        dmin = d;
-        rlpmin = rlp;
+  if (!reuseCorrespondence(curScan, predPose)) {   // 前回の対応を使い回せなければ探す
+    // 点[i0, i1)の対応をcurとrefに入れる。スレッド数が2以上なら点をブロックに分けて並列に求める
+    associateBlocks(curScan->lps.size(), [&](size_t i0, size_t i1, vector<const LPoint2D*> &cur, vector<const LPoint2D*> &ref) {
+      for (size_t i=i0; i<i1; i++) {
+        const LPoint2D *clp = &(curScan->lps[i]);     // 現在スキャンの点。ポインタで。
+
+        // スキャン点lpをpredPoseで座標変換した位置に最も近い点を見つける
+        LPoint2D glp;                                 // clpの予測位置
+        predPose.globalPoint(*clp, glp);              // predPoseで座標変換
+
+        double dmin = HUGE_VAL;                       // 距離最小値
+        const LPoint2D *rlpmin = nullptr;             // 最も近い点
+        for (size_t j=0; j<baseLps.size(); j++) {
+          const LPoint2D *rlp = baseLps[j];           // 参照スキャン点
+          double d = (glp.x - rlp->x)*(glp.x - rlp->x) + (glp.y - rlp->y)*(glp.y - rlp->y);
+          if (d <= dthre*dthre && d < dmin) {         // dthre内で距離が最小となる点を保存
+            dmin = d;
+            rlpmin = rlp;
+          }
+        }
+        if (rlpmin != nullptr) {                      // 最近傍点があれば登録
+          cur.push_back(clp);
+          ref.push_back(rlpmin);
+        }
       }
-    }
-    if (rlpmin != nullptr) {                        // 最近傍点があれば登録
-      curLps.push_back(clp);
-      refLps.push_back(rlpmin);
-    }
+    });
+    saveCorrespondence(curScan, predPose);
   }
   
   double ratio = (1.0*curLps.size())/curScan->lps.size();         // 対応がとれた点の比率
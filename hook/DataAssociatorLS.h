@@ -35,6 +35,13 @@ public:
     baseLps.clear();
     for (size_t i=0; i<rlps.size(); i++)
       baseLps.push_back(&rlps[i]);                // ポインタにして格納
+    clearReuse();
+  }
+
+  virtual DataAssociator *clone() const {
+    DataAssociatorLS *d = new DataAssociatorLS();
+    d->copySettings(*this);
+    return(d);
   }
 
 /////////
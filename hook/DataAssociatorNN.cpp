@@ -21,19 +21,13 @@ using namespace std;
 double DataAssociatorNN::findCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
   chrono_time t0 = clock();  
 
-  curLps.clear();                                   // 対応づけ現在スキャン点群を空にする
-  refLps.clear();                                   // 対応づけ参照スキャン点群を空にする
-  for (size_t i=0; i<curScan->lps.size(); i++) {
-    const LPoint2D *clp = &(curScan->lps[i]);       // 現在スキャンの点。ポインタで。
-    LPoint2D glp;                           // clpの予測位置
-    predPose.globalPoint(*clp, glp);         // relPoseで座標変換
-
-    // nearest neighborにより最近傍点を求める。
-    const LPoint2D *rlp = nnfin->getNearestNeighbor(&glp, allLps, dthre);
-    if (rlp != nullptr) {
-      curLps.push_back(clp);
-      refLps.push_back(rlp);
-    }
+  if (!reuseCorrespondence(curScan, predPose)) {   // 前回の対応を使い回せなければ探す
+    // nearest neighborにより、現在スキャンの全点について最近傍点をまとめて求める。
+    // 結果はcurLpsとrefLpsに入る。スレッド数が2以上なら点をブロックに分けて並列に求める
+    associateBlocks(curScan->lps.size(), [&](size_t i0, size_t i1, vector<const LPoint2D*> &cur, vector<const LPoint2D*> &ref) {
+      nnfin->getNearestNeighbors(curScan, i0, i1, predPose, dthre, cur, ref);
+    });
+    saveCorrespondence(curScan, predPose);
   }
 
   double ratio = (1.0*curLps.size())/curScan->lps.size();         // 対応がとれた点の比率
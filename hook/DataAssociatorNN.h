@@ -34,12 +34,19 @@ public:
     delete nnfin;
   }
   
-  // 参照スキャンの点rlpsをポインタにしてnntabに入れる
+  // 参照スキャンの点rlpsをポインタにしてnnfinに入れる。同じ点群なら索引は作り直さない
   virtual void setRefBase(const std::vector<LPoint2D> &rlps) {
     allLps.clear();
     for (size_t i=0; i<rlps.size(); i++) 
       allLps.push_back(&rlps[i]);              // ポインタにして格納
     nnfin->makeIndex(allLps);
+    clearReuse();
+  }
+
+  virtual DataAssociator *clone() const {
+    DataAssociatorNN *d = new DataAssociatorNN();
+    d->copySettings(*this);
+    return(d);
   }
 
 /////////
@@ -0,0 +1,130 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file DataAssociatorProjective.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include "DataAssociatorProjective.h"
+
+using namespace std;
+
+// 現在スキャンcurScanの各スキャン点をpredPoseで座標変換した位置に最も近い点を、
+// 参照スキャンの計測位置から見て同じ方向付近の点から見つける
+double DataAssociatorProjective::findCorrespondence(const Scan2D *curScan, const Pose2D &predPose) {
+  chrono_time t0 = clock();
+
+  if (!reuseCorrespondence(curScan, predPose)) {   // 前回の対応を使い回せなければ探す
+    associateBlocks(curScan->lps.size(), [&](size_t i0, size_t i1, vector<const LPoint2D*> &cur, vector<const LPoint2D*> &ref) {
+      if (hasRefPose)
+        findBlock(curScan, i0, i1, predPose, cur, ref);
+      else
+        nntab.findClosestPoints(curScan, i0, i1, predPose, dthre, cur, ref);
+    });
+    saveCorrespondence(curScan, predPose);
+  }
+
+  double ratio = (1.0*curLps.size())/curScan->lps.size();         // 対応がとれた点の比率
+
+  chrono_time t1 = clock();
+  totalTime += duration(t0, t1);                // 処理時間
+  ++timeCnt;
+
+  return(ratio);
+}
+
+// 参照スキャンの点rlpsを、refPoseから見た方向のビンに分けて詰める
+void DataAssociatorProjective::makeBins(const vector<LPoint2D> &rlps) {
+  binNum = static_cast<int>(ceil(360/abin));
+  sinWin.resize(maxWin+1);
+  for (int j=0; j<=maxWin; j++)
+    sinWin[j] = sin(DEG2RAD(min(j*abin, 90.0)));
+  size_t n = rlps.size();
+  vector<int> bins(n);                          // 各点のビン
+  offsets.assign(binNum+1, 0);
+  for (size_t i=0; i<n; i++) {
+    double r;
+    int b = angleBin(rlps[i].x - refPose.tx, rlps[i].y - refPose.ty, r);
+    bins[i] = b;
+    ++offsets[b+1];
+  }
+  for (int b=0; b<binNum; b++)
+    offsets[b+1] += offsets[b];
+
+  xs.resize(n);
+  ys.resize(n);
+  bps.resize(n);
+  vector<int> pos(offsets.begin(), offsets.end()-1);      // 各ビンの次の書き込み位置
+  for (size_t i=0; i<n; i++) {
+    int k = pos[bins[i]]++;
+    xs[k] = rlps[i].x;
+    ys[k] = rlps[i].y;
+    bps[k] = &rlps[i];
+  }
+}
+
+// 地図座標系でのrefPoseからの変位(dx, dy)について、refPoseから見た方向のビンを返す。rには距離を入れる
+int DataAssociatorProjective::angleBin(double dx, double dy, double &r) const {
+  const double (*R)[2] = refPose.Rmat;
+  double lx = R[0][0]*dx + R[1][0]*dy;          // refPoseの座標系に変換（回転の逆）
+  double ly = R[0][1]*dx + R[1][1]*dy;
+  r = sqrt(lx*lx + ly*ly);
+  double a = RAD2DEG(atan2(ly, lx)) + 180;      // 0以上360以下
+  int b = static_cast<int>(a/abin);
+  if (b >= binNum)                              // a=360のとき
+    b = binNum-1;
+  return(b);
+}
+
+// curScanの点[i0, i1)について、predPoseで座標変換した位置を参照スキャンの計測位置から見て、
+// その方向のビンと両隣のビンから距離dthre以内で最も近い点を見つける。
+void DataAssociatorProjective::findBlock(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, vector<const LPoint2D*> &cur, vector<const LPoint2D*> &ref) const {
+  const vector<LPoint2D> &lps = curScan->lps;
+  const double (*R)[2] = predPose.Rmat;
+  for (size_t i=i0; i<i1; i++) {
+    const LPoint2D &clp = lps[i];
+    double gx = R[0][0]*clp.x + R[0][1]*clp.y + predPose.tx;      // clpの予測位置
+    double gy = R[1][0]*clp.x + R[1][1]*clp.y + predPose.ty;
+    if (!isfinite(gx) || !isfinite(gy))                        // 予測位置が求まらない点は使わない
+      continue;
+
+    double r;
+    int b = angleBin(gx - refPose.tx, gy - refPose.ty, r);
+
+    // dthreが見込む角度の分だけ両隣を探す。ただしmaxWinまで
+    int w = maxWin;
+    for (int j=1; j<maxWin; j++) {
+      if (dthre <= r*sinWin[j]) {               // asin(dthre/r) <= j*abin
+        w = j;
+        break;
+      }
+    }
+
+    double dmin = dthre*dthre;
+    int kmin = -1;
+    for (int j=-w; j<=w; j++) {
+      int bj = (b + j + binNum)%binNum;         // 360度で一周させる
+      for (int k=offsets[bj]; k<offsets[bj+1]; k++) {
+        double dx = xs[k] - gx;
+        double dy = ys[k] - gy;
+        double d = dx*dx + dy*dy;
+        if (d <= dmin && (kmin < 0 || d < dmin)) {   // dthre内で距離が最小となる点を保存
+          dmin = d;
+          kmin = k;
+        }
+      }
+    }
+
+    if (kmin >= 0) {
+      cur.push_back(&clp);
+      ref.push_back(bps[kmin]);
+    }
+  }
+}
@@ -0,0 +1,90 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file DataAssociatorProjective.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef DATA_ASSOCIATOR_PROJECTIVE_H_
+#define DATA_ASSOCIATOR_PROJECTIVE_H_
+
+#include "DataAssociator.h"
+#include "NNGridFrozen.h"
+
+// 参照スキャンを計測した位置から見た方向で、現在スキャンと参照スキャン間の点の対応づけを行う。
+// 参照スキャンの点を方向ごとのビンに分けておき（極座標画像）、
+// 現在スキャンの点はその方向のビンと両隣の数個のビンだけを探すので、1点あたりの手間は一定になる。
+// 参照スキャンは1回の計測で得た点群であること。RefScanMakerBSと組み合わせて使う。
+class DataAssociatorProjective : public DataAssociator
+{
+private:
+  double abin;                              // ビンの角度幅[度]
+  int maxWin;                               // 探すビンの片側の最大数
+  Pose2D refPose;                           // 参照スキャンを計測したロボット位置
+  bool hasRefPose;                          // refPoseが使えるか
+
+  int binNum;                               // ビンの数
+  std::vector<double> sinWin;               // j個のビンが見込む角度の正弦。窓幅をasinなしで決めるため
+  std::vector<int> offsets;                 // 各ビンの点の先頭位置。要素数はbinNum+1
+  std::vector<double> xs;                   // 点のx座標（地図座標系）。ビンの順
+  std::vector<double> ys;                   // 点のy座標（地図座標系）。ビンの順
+  std::vector<const LPoint2D*> bps;         // 元の点。ビンの順
+
+  NNGridFrozen nntab;                       // 計測位置がわからないときに使う格子テーブル
+
+public:
+  DataAssociatorProjective() : abin(1.0), maxWin(3), hasRefPose(false), binNum(0) {
+  }
+
+  ~DataAssociatorProjective() {
+  }
+
+  void setAngleBin(double a) {
+    abin = a;
+  }
+
+  void setMaxWindow(int w) {
+    maxWin = w;
+  }
+
+  // 参照スキャンの点rlpsを登録する。計測位置がわからないので、格子テーブルで対応づける
+  virtual void setRefBase(const std::vector<LPoint2D> &rlps) {
+    hasRefPose = false;
+    nntab.build(rlps, dthre/2);
+    clearReuse();
+  }
+
+  // 参照スキャンrを登録する。r->poseを計測位置として、点を方向ごとのビンに分ける
+  virtual void setRefScan(const Scan2D *r) {
+    refPose = r->pose;
+    hasRefPose = true;
+    makeBins(r->lps);
+    clearReuse();
+  }
+
+  virtual DataAssociator *clone() const {
+    DataAssociatorProjective *d = new DataAssociatorProjective();
+    d->copySettings(*this);
+    d->abin = abin;
+    d->maxWin = maxWin;
+    return(d);
+  }
+
+/////////
+
+  virtual double findCorrespondence(const Scan2D *curScan, const Pose2D &predPose);
+
+private:
+  void makeBins(const std::vector<LPoint2D> &rlps);
+  int angleBin(double dx, double dy, double &r) const;
+  void findBlock(const Scan2D *curScan, size_t i0, size_t i1, const Pose2D &predPose, std::vector<const LPoint2D*> &cur, std::vector<const LPoint2D*> &ref) const;
+};
+
+#endif
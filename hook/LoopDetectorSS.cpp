@@ -12,6 +12,8 @@
  * @author Masahiro Tomono
  ****************************************************************************/
 
+#include <atomic>
+#include <algorithm>
 #include "LoopDetectorSS.h"
 
 using namespace std;
@@ -23,51 +25,41 @@ using namespace std;
 bool LoopDetectorSS::detectLoop(Scan2D *curScan, Pose2D &curPose, int cnt) {
   printf("-- detectLoop -- \n");
 
-  // 最も近い部分地図を探す
-  double atd = pcmap->atd;                             // 現在の実際の累積走行距離
-  double atdR = 0;                                     // 下記の処理で軌跡をなぞる時の累積走行距離
-  const vector<Submap> &submaps = pcmap->submaps;      // 部分地図
-  const vector<Pose2D> &poses = pcmap->poses;          // ロボット軌跡
-  double dmin=HUGE_VAL;                                // 前回訪問点までの距離の最小値
-  size_t imin=0, jmin=0;                               // 距離最小の前回訪問点のインデックス
-  Pose2D prevP;                                        // 直前のロボット位置
-  for (size_t i=0; i<submaps.size()-1; i++) {          // 現在の部分地図以外を探す
-    const Submap &submap = submaps[i];                 // i番目の部分地図
-    for (size_t j=submap.cntS; j<=submap.cntE; j++) {  // 部分地図の各ロボット位置について
-      Pose2D p = poses[j];                             // ロボット位置
-      atdR += sqrt((p.tx - prevP.tx)*(p.tx - prevP.tx) + (p.ty - prevP.ty)*(p.ty - prevP.ty));
-      if (atd-atdR < atdthre) {                        // 現在位置までの走行距離が短いとループとみなさず、もうやめる
-        i = submaps.size();                            // これで外側のループからも抜ける
-        break;
-      }
-      prevP = p;
-
-      double d = (curPose.tx - p.tx)*(curPose.tx - p.tx) + (curPose.ty - p.ty)*(curPose.ty - p.ty);
-      if (d < dmin) {                                  // 現在位置とpとの距離がこれまでの最小か
-        dmin = d;
-        imin = i;                                      // 候補となる部分地図のインデックス
-        jmin = j;                                      // 前回訪問点のインデックス
-      }
-//      printf("i=%zu, j=%zu: atd=%g, atdR=%g, atdthre=%g\n", i, j, atd, atdR, atdthre);             // 確認用
-    }
-  }
+  // 前回訪問点の候補を索引から探す。現在位置までの走行距離が短い位置は、ループとみなさないので除く
+  updatePoseIndex();
+  double atd = useSnapshot ? snapAtd : pcmap->atd;    // 現在の実際の累積走行距離
+  const vector<Submap> &submaps = getSubmaps();        // 部分地図
+  const vector<Pose2D> &poses = getPoses();            // ロボット軌跡
+  size_t n = pindex.countAtd(atd - atdthre);           // 走行距離の条件を満たすロボット位置の数
+  vector<size_t> cands;                                // 前回訪問点の候補。近い順
+  pindex.findNearPoses(curPose, radius, n, candNum, cands);
 
-  printf("dmin=%g, radius=%g, imin=%zu, jmin=%zu\n", sqrt(dmin), radius, imin, jmin);  // 確認用
+  printf("cands.size=%zu, radius=%g, n=%zu\n", cands.size(), radius, n);  // 確認用
 
-  if (dmin > radius*radius)                            // 前回訪問点までの距離が遠いとループ検出しない
-    return(false);
+  // 候補の部分地図を近い順に調べ、最初に再訪点が見つかったものでループとする
+  bool flag = false;
+  size_t imin=0, jmin=0;                               // 前回訪問点の部分地図とロボット位置のインデックス
+  Pose2D revisitPose;
+  vector<size_t> tried;                                // 調べた部分地図
+  for (size_t c=0; c<cands.size() && !flag; c++) {
+    jmin = cands[c];
+    imin = findSubmap(jmin);
+    if (find(tried.begin(), tried.end(), imin) != tried.end())   // 同じ部分地図は調べ直さない
+      continue;
+    tried.push_back(imin);
 
-  Submap &refSubmap = pcmap->submaps[imin];            // 最も近い部分地図を参照スキャンにする
-  const Pose2D &initPose = poses[jmin];
-  printf("curPose:  tx=%g, ty=%g, th=%g\n", curPose.tx, curPose.ty, curPose.th);
-  printf("initPose: tx=%g, ty=%g, th=%g\n", initPose.tx, initPose.ty, initPose.th);
+    const Pose2D &initPose = poses[jmin];
+    printf("imin=%zu, jmin=%zu\n", imin, jmin);     // 確認用
+    printf("curPose:  tx=%g, ty=%g, th=%g\n", curPose.tx, curPose.ty, curPose.th);
+    printf("initPose: tx=%g, ty=%g, th=%g\n", initPose.tx, initPose.ty, initPose.th);
 
-  // 再訪点の位置を求める
-  Pose2D revisitPose;
-  bool flag = estimateRevisitPose(curScan, refSubmap.mps, curPose, revisitPose);
-//  bool flag = estimateRelativePose(curScan, refSubmap.mps, initPose, revisitPose);
+    // 再訪点の位置を求める
+    flag = estimateRevisitPose(curScan, *submaps[imin].mps, curPose, revisitPose);
+//    flag = estimateRelativePose(curScan, *submaps[imin].mps, initPose, revisitPose);
+  }
 
   if (flag) {                                          // ループを検出した
+    const Submap &refSubmap = submaps[imin];
     Eigen::Matrix3d icpCov;                                                  // ICPの共分散
     pfu->calIcpCovariance(revisitPose, curScan, icpCov);      // ICPの共分散を計算
 
@@ -82,7 +74,7 @@ bool LoopDetectorSS::detectLoop(Scan2D *curScan, Pose2D &curPose, int cnt) {
     Scan2D refScan;
     Pose2D spose = poses[refSubmap.cntS];
     refScan.setSid(info.refId);
-    refScan.setLps(refSubmap.mps);
+    refScan.setLps(*refSubmap.mps);
     refScan.setPose(spose);
     LoopMatch lm(*curScan, refScan, info);
     loopMatches.emplace_back(lm);
@@ -94,13 +86,50 @@ bool LoopDetectorSS::detectLoop(Scan2D *curScan, Pose2D &curPose, int cnt) {
 
 //////////
 
+// 確定した部分地図のロボット位置を索引に加える。前回から増えた分だけ加えるが、
+// ポーズ調整でロボット軌跡が修正されていたら、累積走行距離も変わるので作り直す
+void LoopDetectorSS::updatePoseIndex() {
+  const vector<Submap> &submaps = getSubmaps();
+  const vector<Pose2D> &poses = getPoses();
+
+  pindex.setCellSize(radius);                            // 探索半径をセルサイズにすると、周囲3x3セルを見れば済む
+  if (getRemakeNum() != pindexRemake) {
+    pindex.clear();
+    pindexRemake = getRemakeNum();
+  }
+
+  if (submaps.size() < 2)                                // 確定した部分地図がまだない
+    return;
+  size_t num = submaps[submaps.size()-2].cntE + 1;       // 確定した部分地図のロボット位置の数
+  if (num < pindex.size())                               // 軌跡が短くなった（別の地図に替わった）
+    pindex.clear();
+  for (size_t j=pindex.size(); j<num; j++)
+    pindex.addPose(poses[j]);
+}
+
+// ロボット位置の番号jを含む確定した部分地図の番号を返す。部分地図の番号は連続しているので二分探索する
+size_t LoopDetectorSS::findSubmap(size_t j) const {
+  const vector<Submap> &submaps = getSubmaps();
+  size_t lo = 0, hi = submaps.size()-1;                  // 最後（現在）の部分地図は含めない
+  while (lo < hi) {
+    size_t mid = (lo + hi)/2;
+    if (submaps[mid].cntE < j)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return(lo);
+}
+
+//////////
+
 // 前回訪問点(refId)を始点ノード、現在位置(curId)を終点ノードにして、ループアークを生成する。
 void LoopDetectorSS::makeLoopArc(LoopInfo &info) {
   if (info.arcked)                                             // infoのアークはすでに張ってある
     return;
   info.setArcked(true);
 
-  Pose2D srcPose = pcmap->poses[info.refId];                   // 前回訪問点の位置
+  Pose2D srcPose = getPoses()[info.refId];                     // 前回訪問点の位置
   Pose2D dstPose(info.pose.tx, info.pose.ty, info.pose.th);    // 再訪点の位置
   Pose2D relPose;
   Pose2D::calRelativePose(dstPose, srcPose, relPose);          // ループアークの拘束
@@ -127,7 +156,10 @@ void LoopDetectorSS::makeLoopArc(LoopInfo &info) {
 //////////
 
 // 現在スキャンcurScanと部分地図の点群refLpsでICPを行い、再訪点の位置を求める。
+// 候補位置の探索とICPによる絞り込みは、スレッドごとの部品で並列に行う。
 bool LoopDetectorSS::estimateRevisitPose(const Scan2D *curScan, const vector<LPoint2D> &refLps, const Pose2D &initPose, Pose2D &revisitPose) {
+  makeWorkers();                                         // スレッドごとの部品を用意する
+  size_t tn = wks.size();
   dass->setRefBase(refLps);                              // データ対応づけ器に参照点群を設定
   cfunc->setEvlimit(0.2);                                // コスト関数の誤差閾値
 
@@ -136,63 +168,114 @@ bool LoopDetectorSS::estimateRevisitPose(const Scan2D *curScan, const vector<LPo
   size_t usedNumMin = 50; 
 //  size_t usedNumMin = 100;
 
-  // 初期位置initPoseの周囲をしらみつぶしに調べる。
+  // 初期位置initPoseの周囲をしらみつぶしに調べる。cmatがあれば、相関による分枝限定法で調べる。
   // 効率化のため、ICPは行わず、各位置で単純にマッチングスコアを調べる。
   double rangeT = 1;                                     // 並進の探索範囲[m]
   double rangeA = 45;                                    // 回転の探索範囲[度]
   double dd = 0.2;                                       // 並進の探索間隔[m]
   double da = 2;                                         // 回転の探索間隔[度]
-  vector<double> pnrates;
-  double scoreMin=1000;
   vector<double> scores;
   vector<Pose2D> candidates;                             // スコアのよい候補位置
-  for (double dy=-rangeT; dy<=rangeT; dy+=dd) {          // 並進yの探索繰り返し
-    double y = initPose.ty + dy;                         // 初期位置に変位分dyを加える
-    for (double dx=-rangeT; dx<=rangeT; dx+=dd) {        // 並進xの探索繰り返し
-      double x = initPose.tx + dx;                       // 初期位置に変位分dxを加える
-      for (double dth=-rangeA; dth<=rangeA; dth+=da) {   // 回転の探索繰り返し
-        double th = MyUtil::add(initPose.th, dth);       // 初期位置に変位分dthを加える
-        Pose2D pose(x, y, th);
-        double mratio = dass->findCorrespondence(curScan, pose);   // 位置poseでデータ対応づけ
-        size_t usedNum = dass->curLps.size();
-//        printf("usedNum=%zu, mratio=%g\n", usedNum, mratio);          // 確認用
-        if (usedNum < usedNumMin || mratio < 0.9)        // 対応率が悪いと飛ばす
-          continue;
-        cfunc->setPoints(dass->curLps, dass->refLps);    // コスト関数に点群を設定
-        double score =  cfunc->calValue(x, y, th);       // コスト値（マッチングスコア）
-        double pnrate = cfunc->getPnrate();              // 詳細な点の対応率
-//        printf("score=%g, pnrate=%g\n", score, pnrate);                    // 確認用
-        if (pnrate > 0.8) {
+  if (cmat != nullptr) {                                 // 相関による分枝限定法で、最もよい位置を候補にする
+    cmat->setRefPoints(refLps);
+    Pose2D pose;
+    double score;
+    if (cmat->findPose(curScan->lps, initPose, rangeT, rangeA, pose, score)) {
+      // しらみつぶしの場合と同じく、対応率と詳細な点の対応率がよいときだけ候補にする
+      double mratio = dass->findCorrespondence(curScan, pose);
+      size_t usedNum = dass->curLps.size();
+      if (usedNum >= usedNumMin && mratio >= 0.9) {
+        cfunc->setPoints(dass->curLps, dass->refLps);
+        cfunc->calValue(pose.tx, pose.ty, pose.th);
+        if (cfunc->getPnrate() > 0.8) {
           candidates.emplace_back(pose);
-          if (score < scoreMin)
-            scoreMin = score;
           scores.push_back(score);
-//          printf("pose: tx=%g, ty=%g, th=%g\n", pose.tx, pose.ty, pose.th);  // 確認用
-//          printf("score=%g, pnrate=%g\n", score, pnrate);                    // 確認用
         }
       }
     }
   }
+  else {
+    // 調べる位置を先に並べておき、各スレッドが残りの位置を1つずつ取って調べる。
+    // 結果は位置の番号ごとに入れて、あとで番号順に集めるので、候補の順序はスレッド数によらない
+    vector<Pose2D> poses;
+    for (double dy=-rangeT; dy<=rangeT; dy+=dd) {          // 並進yの探索繰り返し
+      double y = initPose.ty + dy;                         // 初期位置に変位分dyを加える
+      for (double dx=-rangeT; dx<=rangeT; dx+=dd) {        // 並進xの探索繰り返し
+        double x = initPose.tx + dx;                       // 初期位置に変位分dxを加える
+        for (double dth=-rangeA; dth<=rangeA; dth+=da) {   // 回転の探索繰り返し
+          double th = MyUtil::add(initPose.th, dth);       // 初期位置に変位分dthを加える
+          poses.emplace_back(x, y, th);
+        }
+      }
+    }
+
+    vector<double> pscores(poses.size(), -1);              // 各位置のスコア。候補にならなければ-1
+    atomic<size_t> next(0);
+    workers.run(tn, [&](size_t k) {
+      Worker &w = wks[k];
+      if (k > 0) {                                         // 複製には参照点群をここで設定する
+        w.dass->setRefBase(refLps);
+        w.cfunc->setEvlimit(0.2);
+      }
+      for (size_t i=next++; i<poses.size(); i=next++) {
+        const Pose2D &pose = poses[i];
+        double mratio = w.dass->findCorrespondence(curScan, pose);   // 位置poseでデータ対応づけ
+        size_t usedNum = w.dass->curLps.size();
+//      printf("usedNum=%zu, mratio=%g\n", usedNum, mratio);          // 確認用
+        if (usedNum < usedNumMin || mratio < 0.9)          // 対応率が悪いと飛ばす
+          continue;
+        w.cfunc->setPoints(w.dass->curLps, w.dass->refLps);          // コスト関数に点群を設定
+        double score =  w.cfunc->calValue(pose.tx, pose.ty, pose.th); // コスト値（マッチングスコア）
+        double pnrate = w.cfunc->getPnrate();              // 詳細な点の対応率
+//      printf("score=%g, pnrate=%g\n", score, pnrate);                    // 確認用
+        if (pnrate > 0.8)
+          pscores[i] = score;
+      }
+    });
+
+    for (size_t i=0; i<poses.size(); i++) {
+      if (pscores[i] >= 0) {
+        candidates.emplace_back(poses[i]);
+        scores.push_back(pscores[i]);
+//      printf("pose: tx=%g, ty=%g, th=%g\n", poses[i].tx, poses[i].ty, poses[i].th);  // 確認用
+      }
+    }
+  }
   printf("candidates.size=%zu\n", candidates.size());                           // 確認用
   if (candidates.size() == 0)
     return(false);
 
-  // 候補位置candidatesの中から最もよいものをICPで選ぶ
+  // 各候補位置からICPを行う。これも候補ごとに並列に行い、結果は候補の番号ごとに入れる
+  vector<Pose2D> estPs(candidates.size());
+  vector<double> icpScores(candidates.size());
+  vector<double> pnrates(candidates.size());
+  vector<size_t> usedNums(candidates.size());
+  atomic<size_t> next(0);
+  workers.run(tn, [&](size_t k) {
+    Worker &w = wks[k];
+    bool paired = false;
+    for (size_t i=next++; i<candidates.size(); i=next++) {
+      if (!paired) {
+        w.estim->setScanPair(curScan, refLps);              // ICPにスキャン設定
+        paired = true;
+      }
+      Pose2D p = candidates[i];                             // 候補位置
+      icpScores[i] = w.estim->estimatePose(p, estPs[i]);    // ICPでマッチング位置を求める
+      pnrates[i] = w.estim->getPnrate();                    // ICPでの点の対応率
+      usedNums[i] = w.estim->getUsedNum();                  // ICPで使用した点数
+    }
+  });
+
+  // 候補位置candidatesの中から最もよいものを選ぶ
   Pose2D best;                                              // 最良候補
   double smin=1000000;                                      // ICPスコア最小値
-  estim->setScanPair(curScan, refLps);                      // ICPにスキャン設定
   for (size_t i=0; i<candidates.size(); i++) {
-    Pose2D p = candidates[i];                               // 候補位置
     printf("score=%g\n", scores[i]);    // 確認用
-    Pose2D estP;
-    double score = estim->estimatePose(p, estP);            // ICPでマッチング位置を求める
-    double pnrate = estim->getPnrate();                     // ICPでの点の対応率
-    size_t usedNum = estim->getUsedNum();                   // ICPで使用した点数
-    if (score < smin && pnrate >= 0.9 && usedNum >= usedNumMin) {  // ループ検出は条件厳しく
-//    if (score < smin && usedNum >= usedNumMin) {  // ループ検出は条件厳しく
-      smin = score;
-      best = estP;
-      printf("smin=%g, pnrate=%g, usedNum=%zu\n", smin, pnrate, usedNum);    // 確認用
+    if (icpScores[i] < smin && pnrates[i] >= 0.9 && usedNums[i] >= usedNumMin) {  // ループ検出は条件厳しく
+//    if (icpScores[i] < smin && usedNums[i] >= usedNumMin) {  // ループ検出は条件厳しく
+      smin = icpScores[i];
+      best = estPs[i];
+      printf("smin=%g, pnrate=%g, usedNum=%zu\n", smin, pnrates[i], usedNums[i]);    // 確認用
     }
   }
 
@@ -204,3 +287,112 @@ bool LoopDetectorSS::estimateRevisitPose(const Scan2D *curScan, const vector<LPo
 
   return(false);
 }
+
+//////////
+
+// スレッド数だけ部品を用意する。0番目は設定された部品をそのまま使い、ほかは複製する
+void LoopDetectorSS::makeWorkers() {
+  size_t tn = workers.getThreadNum();
+  if (wks.size() == tn)
+    return;
+
+  deleteWorkers();
+  Worker w0 = {dass, cfunc, estim};
+  wks.push_back(w0);
+  for (size_t k=1; k<tn; k++)
+    wks.push_back(cloneComponents());
+}
+
+// 複製した部品を消す
+void LoopDetectorSS::deleteWorkers() {
+  for (size_t k=1; k<wks.size(); k++)
+    deleteComponents(wks[k]);
+  wks.clear();
+}
+
+// 部品の複製を作る。元の部品どうしで同じものを共有していれば
+// （ICPとこのクラスで同じデータ対応づけ器を使うなど）、複製でも共有させる
+LoopDetectorSS::Worker LoopDetectorSS::cloneComponents() const {
+  Worker w;
+  w.dass = dass->clone();
+  w.cfunc = cfunc->clone();
+
+  PoseOptimizer *popt = estim->getPoseOptimizer();
+  DataAssociator *d = (estim->getDataAssociator() == dass) ? w.dass : estim->getDataAssociator()->clone();
+  CostFunction *f = (popt->getCostFunction() == cfunc) ? w.cfunc : popt->getCostFunction()->clone();
+  PoseOptimizer *p = popt->clone();
+  p->setCostFunction(f);
+  w.estim = new PoseEstimatorICP(*estim);
+  w.estim->setPoseOptimizer(p);
+  w.estim->setDataAssociator(d);
+
+  return(w);
+}
+
+// cloneComponentsで作った部品を消す
+void LoopDetectorSS::deleteComponents(Worker &w) {
+  PoseOptimizer *p = w.estim->getPoseOptimizer();
+  if (p->getCostFunction() != w.cfunc)
+    delete p->getCostFunction();
+  delete p;
+  if (w.estim->getDataAssociator() != w.dass)
+    delete w.estim->getDataAssociator();
+  delete w.estim;
+  delete w.cfunc;
+  delete w.dass;
+}
+
+//////////
+
+// ループ検出を別スレッドで行うために、フロントエンドと共有している部品を複製に替える。
+// センサ融合器も、共分散の計算でデータ対応づけ器を使うので複製する
+void LoopDetectorSS::detachComponents() {
+  if (ownComponents)
+    return;
+
+  deleteWorkers();                                       // スレッドごとの部品は、次のループ検出で複製から作り直す
+  Worker w = cloneComponents();
+  DataAssociator *d = pfu->getDataAssociator();
+  PoseFuser *f = new PoseFuser(*pfu);
+  if (d == dass)
+    f->setDataAssociator(w.dass);
+  else if (d == estim->getDataAssociator())
+    f->setDataAssociator(w.estim->getDataAssociator());
+  else {
+    pfuDass = d->clone();
+    f->setDataAssociator(pfuDass);
+  }
+
+  dass = w.dass;
+  cfunc = w.cfunc;
+  estim = w.estim;
+  pfu = f;
+  ownComponents = true;
+}
+
+// ループ検出に使う地図の写しをとる。フロントエンドのスレッドで呼ぶので、地図の大きさに比例する複製はしない。
+// 確定した部分地図の点群は共有するだけで写さない（PointCloudMapLPは確定した点群を書き換えずに差し替える）。
+// ロボット軌跡は前回から増えた分だけ写すが、ポーズ調整で修正されていたら全部写し直す
+void LoopDetectorSS::takeSnapshot() {
+  const vector<Submap> &submaps = pcmap->submaps;
+  const vector<Pose2D> &poses = pcmap->poses;
+  bool remade = (pcmap->remakeNum != snapRemake || snapPoses.size() > poses.size());
+
+  // 確定した部分地図。点群は共有するので、写すのは始点や終点の情報だけ
+  size_t n = snapSubmaps.empty() ? 0 : snapSubmaps.size()-1;    // 写してある確定した部分地図の数
+  if (remade || n > submaps.size()-1)
+    n = 0;
+  snapSubmaps.resize(n);
+  for (size_t i=n; i<submaps.size()-1; i++)
+    snapSubmaps.push_back(submaps[i]);
+  const Submap &curSubmap = submaps.back();
+  snapSubmaps.emplace_back(curSubmap.atdS, curSubmap.cntS);     // 現在の部分地図は探索しないので、点は写さない
+
+  if (remade)
+    snapPoses.clear();
+  snapPoses.insert(snapPoses.end(), poses.begin()+snapPoses.size(), poses.end());
+
+  snapAtd = pcmap->atd;
+  snapRemake = pcmap->remakeNum;
+  useSnapshot = true;
+}
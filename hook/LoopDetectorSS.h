@@ -20,6 +20,9 @@
 #include "DataAssociator.h"
 #include "PoseEstimatorICP.h"
 #include "PoseFuser.h"
+#include "CorrelativeMatcher.h"
+#include "PoseGridIndex.h"
+#include "WorkerPool.h"
 
 
 ////////////
@@ -30,18 +33,49 @@ private:
   double radius;                               // 探索半径[m]（現在位置と再訪点の距離閾値）
   double atdthre;                              // 累積走行距離の差の閾値[m]
   double scthre;                               // ICPスコアの閾値
+  size_t candNum;                              // 調べる前回訪問点の候補数。近い順に、部分地図が重ならないように調べる
 
   PointCloudMapLP *pcmap;                      // 点群地図
   CostFunction *cfunc;                         // コスト関数(ICPとは別に使う)
   PoseEstimatorICP *estim;                     // ロボット位置推定器(ICP)
   DataAssociator *dass;                        // データ対応づけ器
   PoseFuser *pfu;                              // センサ融合器
+  CorrelativeMatcher *cmat;                    // 相関による再訪点の探索器。nullptrならしらみつぶしに探す
+
+  PoseGridIndex pindex;                        // 確定した部分地図のロボット位置の索引
+  size_t pindexRemake;                         // 索引を作ったときの、地図のremakeNum
+
+  // 再訪点の候補を並列に調べるときの、スレッドごとの部品。
+  // 0番目は上の部品そのもので、ほかはそれらの複製（clone）
+  struct Worker {
+    DataAssociator *dass;
+    CostFunction *cfunc;
+    PoseEstimatorICP *estim;
+  };
+  WorkerPool workers;                          // 候補を並列に調べる作業スレッド
+  std::vector<Worker> wks;                     // スレッドごとの部品
+
+  // 別スレッドでループ検出するときに使うもの
+  bool ownComponents;                          // 上の部品を複製に替えて、自分で持っているか
+  DataAssociator *pfuDass;                     // pfuのためだけに複製したデータ対応づけ器。なければnullptr
+  bool useSnapshot;                            // 地図の代わりに下の写しを使うか
+  std::vector<Submap> snapSubmaps;             // 部分地図の写し。現在の部分地図は点を写さない
+  std::vector<Pose2D> snapPoses;               // ロボット軌跡の写し
+  double snapAtd;                              // 累積走行距離の写し
+  size_t snapRemake;                           // remakeNumの写し
 
 public:
-  LoopDetectorSS() : radius(4), atdthre(10), scthre(0.2), pcmap(nullptr), cfunc(nullptr), estim(nullptr), dass(nullptr), pfu(nullptr) {
+  LoopDetectorSS() : radius(4), atdthre(10), scthre(0.2), candNum(1), pcmap(nullptr), cfunc(nullptr), estim(nullptr), dass(nullptr), pfu(nullptr), cmat(nullptr), pindexRemake(0), ownComponents(false), pfuDass(nullptr), useSnapshot(false), snapAtd(0), snapRemake(0) {
   }
 
   ~LoopDetectorSS() {
+    deleteWorkers();
+    if (ownComponents) {
+      Worker w = {dass, cfunc, estim};
+      deleteComponents(w);
+      delete pfu;
+      delete pfuDass;
+    }
   }
 
 /////////
@@ -66,12 +100,51 @@ public:
     pcmap = p;
   }
 
+  void setCorrelativeMatcher(CorrelativeMatcher *c) {
+    cmat = c;
+  }
+
+  // 半径radius内の前回訪問点を近い順にn個まで調べる。1なら最も近いものだけ
+  void setCandidateNum(size_t n) {
+    candNum = (n > 0) ? n : 1;
+  }
+
+  // 再訪点の候補を調べるスレッド数。1なら並列にしない。
+  // 部品の複製は次のループ検出のときに作るので、部品の設定はそれまでに済ませておく
+  void setThreadNum(size_t n) {
+    workers.setThreadNum(n);
+    deleteWorkers();
+  }
+
 //////////
 
   virtual bool detectLoop(Scan2D *curScan, Pose2D &curPose, int cnt);
+  virtual void detachComponents();
+  virtual void takeSnapshot();
   void makeLoopArc(LoopInfo &info);
   bool estimateRevisitPose(const Scan2D *curScan, const std::vector<LPoint2D> &refLps, const Pose2D &initPose, Pose2D &revisitPose);
 
+private:
+  // ループ検出に使う部分地図とロボット軌跡。写しをとっていればそれを使う
+  const std::vector<Submap> &getSubmaps() const {
+    return(useSnapshot ? snapSubmaps : pcmap->submaps);
+  }
+
+  const std::vector<Pose2D> &getPoses() const {
+    return(useSnapshot ? snapPoses : pcmap->poses);
+  }
+
+  size_t getRemakeNum() const {
+    return(useSnapshot ? snapRemake : pcmap->remakeNum);
+  }
+
+  void updatePoseIndex();
+  size_t findSubmap(size_t j) const;
+
+  void makeWorkers();
+  void deleteWorkers();
+  Worker cloneComponents() const;
+  void deleteComponents(Worker &w);
 };
 
 #endif
@@ -23,11 +23,17 @@ void PointCloudMapGT::addPose(const Pose2D &p) {
   poses.emplace_back(p);
 }
 
-// 格子テーブルの各セルの代表点を求めてspsに格納する
+// 格子テーブルの各セルの代表点を求めてspsに格納する。
+// 格子テーブルには前回から増えた点だけを登録し、代表点もそれらの点が入ったセルだけ作り直す
 void PointCloudMapGT::subsamplePoints(vector<LPoint2D> &sps) {
-  nntab.clear();                            // 格子テーブルの初期化
-  for (size_t i=0; i<allLps.size(); i++) 
-    nntab.addPoint(&(allLps[i]));           // 全点を格子テーブルに登録
+  if (allLps.data() != tabBase || tabNum > allLps.size()) {   // allLpsの領域が移動したら、ポインタが無効なので登録し直す
+    nntab.clear();
+    tabNum = 0;
+    tabBase = allLps.data();
+  }
+  for (size_t i=tabNum; i<allLps.size(); i++) 
+    nntab.addPoint(&(allLps[i]));           // 新しい点を格子テーブルに登録
+  tabNum = allLps.size();
 
   nntab.makeCellPoints(nthre, sps);         // nthre点以上あるセルから代表点を得る
 
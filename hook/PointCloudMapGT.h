@@ -27,8 +27,12 @@ public:
   std::vector<LPoint2D> allLps;             // 全スキャン点群
   NNGridTable nntab;                        // 格子テーブル
 
+private:
+  size_t tabNum;                            // allLpsのうち格子テーブルに登録済みの点数
+  const LPoint2D *tabBase;                  // 登録時のallLpsの先頭。領域が移動したら登録し直す
+
 public:
-  PointCloudMapGT() {
+  PointCloudMapGT() : tabNum(0), tabBase(nullptr) {
     allLps.reserve(MAX_POINT_NUM);          // 最初に確保
   }
 
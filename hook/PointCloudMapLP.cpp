@@ -13,7 +13,6 @@
  ****************************************************************************/
 
 #include "PointCloudMapLP.h"
-#include "NNGridTable.h"
 
 using namespace std;
 
@@ -21,19 +20,29 @@ double PointCloudMapLP::atdThre = 10;
 
 ///////////
 
-// 格子テーブルを用いて、部分地図の代表点を得る
-vector<LPoint2D> Submap::subsamplePoints(size_t nthre) {
-  NNGridTable nntab;                     // 格子テーブル
-  for (size_t i=0; i<mps.size(); i++) {
-    LPoint2D &lp = mps[i];
-    nntab.addPoint(&lp);                 // 全点を登録
+// 格子テーブルを用いて、現在の部分地図の代表点を得て、spsの末尾に追加する。
+// 格子テーブルには前回から増えた点だけを登録し、代表点もそれらの点が入ったセルだけ作り直す
+void PointCloudMapLP::subsampleCurrentSubmap(vector<LPoint2D> &sps) {
+  vector<LPoint2D> &mps = *submaps.back().mps;
+  if (mps.data() != tabBase || tabNum > mps.size()) {   // mpsの領域が移動したら、ポインタが無効なので登録し直す
+    nntab.clear();
+    tabNum = 0;
+    tabBase = mps.data();
   }
+  for (size_t i=tabNum; i<mps.size(); i++)
+    nntab.addPoint(&mps[i]);             // 新しい点を登録
+  tabNum = mps.size();
 
-  vector<LPoint2D> sps;
+  size_t n0 = sps.size();
   nntab.makeCellPoints(nthre, sps);      // nthre個以上のセルの代表点をspsに入れる
-  printf("mps.size=%zu, sps.size=%zu\n", mps.size(), sps.size());
+  printf("mps.size=%zu, sps.size=%zu\n", mps.size(), sps.size()-n0);
+}
 
-  return(sps);
+// 格子テーブルを空にする。部分地図が替わったときや、点の位置が変わったときに使う
+void PointCloudMapLP::resetCellTable() {
+  nntab.clear();
+  tabNum = 0;
+  tabBase = nullptr;
 }
 
 /////////
@@ -57,10 +66,15 @@ void PointCloudMapLP::addPoints(const vector<LPoint2D> &lps) {
   Submap &curSubmap = submaps.back();              // 現在の部分地図
   if (atd - curSubmap.atdS >= atdThre ) {          // 累積走行距離が閾値を超えたら新しい部分地図に変える
     size_t size = poses.size();
+    size_t curSize = curSubmap.mps->size();        // 代表点にする前の点数
     curSubmap.cntE = size-1;                       // 部分地図の最後のスキャン番号
-    curSubmap.mps = curSubmap.subsamplePoints(nthre); // 終了した部分地図は代表点のみにする（軽量化）
+    spsBuf.clear();
+    subsampleCurrentSubmap(spsBuf);                // 作業領域で代表点を作ってから、ちょうどの大きさで写す
+    curSubmap.mps = make_shared<vector<LPoint2D>>(spsBuf);   // 終了した部分地図は代表点のみにする（軽量化）
+    resetCellTable();
 
     Submap submap(atd, size);                      // 新しい部分地図
+    submap.mps->reserve(curSize);                  // 直前の部分地図と同程度の点数を見込んで、確保し直しを減らす
     submap.addPoints(lps);                         // スキャン点群の登録
     submaps.emplace_back(submap);                  // 部分地図を追加
   }
@@ -76,7 +90,7 @@ void PointCloudMapLP::makeGlobalMap(){
   // 現在以外のすでに確定した部分地図から点を集める
   for (size_t i=0; i<submaps.size()-1; i++) {
     Submap &submap = submaps[i];                   // 部分地図
-    vector<LPoint2D> &mps = submap.mps;            // 部分地図の点群。代表点だけになっている
+    const vector<LPoint2D> &mps = *submap.mps;     // 部分地図の点群。代表点だけになっている
     for (size_t j=0; j<mps.size(); j++) {
       globalMap.emplace_back(mps[j]);              // 全体地図には全点入れる
     }
@@ -87,16 +101,14 @@ void PointCloudMapLP::makeGlobalMap(){
     }
   }
 
-  // 現在の部分地図の代表点を全体地図と局所地図に入れる
+  // 現在の部分地図の代表点を局所地図に入れ、全体地図にも写す
   Submap &curSubmap = submaps.back();              // 現在の部分地図
-  vector<LPoint2D> sps = curSubmap.subsamplePoints(nthre);  // 代表点を得る
-  for (size_t i=0; i<sps.size(); i++) {
-    globalMap.emplace_back(sps[i]);
-    localMap.emplace_back(sps[i]);
-  }
+  size_t n0 = localMap.size();
+  subsampleCurrentSubmap(localMap);                // 代表点を得る
+  globalMap.insert(globalMap.end(), localMap.begin()+n0, localMap.end());
 
   // 以下は確認用
-  printf("curSubmap.atd=%g, atd=%g, sps.size=%zu\n", curSubmap.atdS, atd, sps.size());
+  printf("curSubmap.atd=%g, atd=%g, sps.size=%zu\n", curSubmap.atdS, atd, localMap.size()-n0);
   printf("submaps.size=%zu, globalMap.size=%zu\n", submaps.size(), globalMap.size());
 }
 
@@ -105,18 +117,14 @@ void PointCloudMapLP::makeLocalMap(){
   localMap.clear();                                // 初期化
   if (submaps.size() >= 2) {
     Submap &submap = submaps[submaps.size()-2];    // 直前の部分地図だけ使う
-    vector<LPoint2D> &mps = submap.mps;            // 部分地図の点群。代表点だけになっている
+    const vector<LPoint2D> &mps = *submap.mps;     // 部分地図の点群。代表点だけになっている
     for (size_t i=0; i<mps.size(); i++) {
       localMap.emplace_back(mps[i]);
     }
   }
 
-  // 現在の部分地図の代表点を局所地図に入れる
-  Submap &curSubmap = submaps.back();              // 現在の部分地図
-  vector<LPoint2D> sps = curSubmap.subsamplePoints(nthre);  // 代表点を得る
-  for (size_t i=0; i<sps.size(); i++) {
-    localMap.emplace_back(sps[i]);
-  }
+  // 現在の部分地図の代表点を局所地図に入れる。局所地図の領域は毎回使い回す
+  subsampleCurrentSubmap(localMap);                // 代表点を得る
 
   printf("localMap.size=%zu\n", localMap.size());   // 確認用
 }
@@ -128,7 +136,12 @@ void PointCloudMapLP::remakeMaps(const vector<Pose2D> &newPoses){
   // 各部分地図内の点の位置を修正する
   for (size_t i=0; i<submaps.size(); i++) {
     Submap &submap = submaps[i];
-    vector<LPoint2D> &mps = submap.mps;                // 部分地図の点群。現在地図以外は代表点になっている
+    // 部分地図の点群。現在地図以外は代表点になっている。
+    // 確定した部分地図はループ検出の写しと共有しているかもしれないので、複製を修正して差し替える。
+    // 現在の部分地図は共有しないので、そのまま修正して領域を使い続ける
+    if (i+1 < submaps.size())
+      submap.mps = make_shared<vector<LPoint2D>>(*submap.mps);
+    vector<LPoint2D> &mps = *submap.mps;
     for (size_t j=0; j<mps.size(); j++) {
       LPoint2D &mp = mps[j];
       size_t idx = mp.sid;                             // 点のスキャン番号
@@ -152,6 +165,7 @@ void PointCloudMapLP::remakeMaps(const vector<Pose2D> &newPoses){
     }
   }
 
+  resetCellTable();                                    // 点が動いたので格子テーブルを作り直す
   makeGlobalMap();                                     // 部分地図から全体地図と局所地図を生成
 
   printf("lastPose=(%g %g %g)\n", lastPose.tx, lastPose.ty, lastPose.th);  
@@ -160,6 +174,7 @@ void PointCloudMapLP::remakeMaps(const vector<Pose2D> &newPoses){
     poses[i] = newPoses[i];
   }
   lastPose = newPoses.back();
+  ++remakeNum;
 
   printf("lastPose=(%g %g %g)\n", lastPose.tx, lastPose.ty, lastPose.th);  
 }
@@ -15,7 +15,9 @@
 #ifndef POINT_CLOUD_MAP_LP_H_
 #define POINT_CLOUD_MAP_LP_H_
 
+#include <memory>
 #include "PointCloudMap.h"
+#include "NNGridTable.h"
 
 ///////////
 
@@ -26,22 +28,22 @@ struct Submap
   size_t cntS;                              // 部分地図の最初のスキャン番号
   size_t cntE;                              // 部分地図の最後のスキャン番号
 
-  std::vector<LPoint2D> mps;                // 部分地図内のスキャン点群
+  // 部分地図内のスキャン点群。確定した部分地図の点群は、別スレッドのループ検出の写しと共有するので、
+  // 書き換えずに新しい点群を作って差し替える
+  std::shared_ptr<std::vector<LPoint2D>> mps;
 
-  Submap() : atdS(0), cntS(0), cntE(-1) {
+  Submap() : atdS(0), cntS(0), cntE(-1), mps(std::make_shared<std::vector<LPoint2D>>()) {
   }
 
-  Submap(double a, size_t s) : cntE(-1) {
+  Submap(double a, size_t s) : cntE(-1), mps(std::make_shared<std::vector<LPoint2D>>()) {
     atdS = a;
     cntS = s;
   }
 
   void addPoints(const std::vector<LPoint2D> &lps) {
     for (size_t i=0; i<lps.size(); i++)
-      mps.emplace_back(lps[i]);
+      mps->emplace_back(lps[i]);
   }
-
-  std::vector<LPoint2D> subsamplePoints(size_t nthre);
 };
 
 ///////////
@@ -53,9 +55,16 @@ public:
   static double atdThre;                    // 部分地図の区切りとなる累積走行距離(atd)[m]
   double atd;                               // 現在の累積走行距離(accumulated travel distance)
   std::vector<Submap> submaps;              // 部分地図
+  size_t remakeNum;                         // remakeMapsでロボット軌跡を修正した回数
+
+private:
+  NNGridTable nntab;                        // 現在の部分地図の格子テーブル。点を追加するたびに更新する
+  size_t tabNum;                            // 現在の部分地図の点のうち、格子テーブルに登録済みの点数
+  const LPoint2D *tabBase;                  // 登録時の点群の先頭。領域が移動したら登録し直す
+  std::vector<LPoint2D> spsBuf;             // 部分地図を終了するときの代表点。作業用
 
 public:
-  PointCloudMapLP() : atd(0) {
+  PointCloudMapLP() : atd(0), remakeNum(0), tabNum(0), tabBase(nullptr) {
     Submap submap;
     submaps.emplace_back(submap);           // 最初の部分地図を作っておく
   }
@@ -85,6 +94,9 @@ public:
   virtual void makeLocalMap();
   virtual void remakeMaps(const std::vector<Pose2D> &newPoses);
 
+private:
+  void subsampleCurrentSubmap(std::vector<LPoint2D> &sps);
+  void resetCellTable();
 };
 
 #endif
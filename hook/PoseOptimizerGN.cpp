@@ -23,14 +23,14 @@ using namespace std;
 // データ対応づけ固定のもと、初期値initPoseを与えてロボット位置の推定値estPoseを求める
 double PoseOptimizerGN::optimizePose(Pose2D &initPose, Pose2D &estPose) {
   chrono_time t0 = clock();  
-//  printf("curLps.size=%zu, refLps.size=%zu\n", curLps.size(), refLps.size());
+//  printf("curPc.size=%zu, refPc.size=%zu\n", curPc.size(), refPc.size());
 
   const static int MAX_STEPS = 10;
   Pose2D pose = initPose;
   double prevErr = 1000000;
   for (int i=0; i<MAX_STEPS; ++i) {
     Pose2D npose;
-    double curErr = calGaussNewton(pose, curLps, refLps, npose);
+    double curErr = calGaussNewton(pose, npose);
 
     if (abs(prevErr - curErr) <= evthre) {   // 収束
       if (curErr < prevErr) {
@@ -63,68 +63,125 @@ double PoseOptimizerGN::optimizePose(Pose2D &initPose, Pose2D &estPose) {
 
 //////
 
-// 推定位置pose、現在スキャン点群curLps、参照スキャン点群refLps
-double PoseOptimizerGN::calGaussNewton(const Pose2D &pose, vector<const LPoint2D*> &curLps, vector<const LPoint2D*> &refLps, Pose2D &newPose) {
+// 推定位置poseでガウスニュートン法を1ステップ行い、newPoseを求める。
+// 正規方程式の係数は、CostKernelで対応点を1回走査してまとめて計算する
+double PoseOptimizerGN::calGaussNewton(const Pose2D &pose, Pose2D &newPose) {
   double tx = pose.tx;
   double ty = pose.ty;
   double th = pose.th;
   double a = DEG2RAD(th);
-  double cs = cos(a);
-  double sn = sin(a);
 
-  Eigen::Matrix3d JWJ = Eigen::Matrix3d::Zero(3,3);  
-  Eigen::Vector3d JWe = Eigen::Vector3d::Zero(3);  
-  double totalErr=0;
+  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_HUBER : CostKernel::ROBUST_NONE;
+//  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_TUKEY : CostKernel::ROBUST_NONE;
 
-  for (size_t i=0; i<curLps.size(); i++) {
-    const LPoint2D *clp = curLps[i];                         // 現在スキャンの点
-    const LPoint2D *rlp = refLps[i];                         // 参照スキャンの点
+  double H[6], g[3];
+  double totalErr = CostKernel::accumulateNormalEq(curPc, refPc, tx, ty, a, rtype, evlimit, H, g);
 
-    if (rlp->type != LINE)                                   // 法線のない点は使わない
-      continue;
+  Eigen::Matrix3d JWJ;
+  JWJ << H[0], H[1], H[2],
+         H[1], H[3], H[4],
+         H[2], H[4], H[5];
+  Eigen::Vector3d JWe(g[0], g[1], g[2]);
+  
+  Eigen::Vector3d d = -JWJ.inverse()*JWe;
+  newPose.setVal(tx+d(0), ty+d(1), MyUtil::add(th, RAD2DEG(d(2))));
 
-    double cx = clp->x;
-    double cy = clp->y;
+//  printf("newPose=(%g %g %g), totalErr=%g\n", newPose.tx, newPose.ty, newPose.th, totalErr);
+
+  return(totalErr);
+}
 
-    if (hasOutliers)
-      addNoise(i, cx, cy);       // 外れ値テスト
+////////
 
-    Eigen::Matrix2d W;
-    W(0,0) = rlp->nx*rlp->nx;
-    W(1,0) = rlp->ny*rlp->nx;
-    W(0,1) = rlp->nx*rlp->ny;
-    W(1,1) = rlp->ny*rlp->ny;
+// 距離場dfの上で、初期値initPoseを与えて点群lpsの位置estPoseを求める。
+// 距離とその勾配は距離場から直接求まるので、データ対応づけをしないで繰り返す
+double PoseOptimizerGN::optimizePoseDF(const DistanceField2D &df, const vector<LPoint2D> &lps, Pose2D &initPose, Pose2D &estPose) {
+  chrono_time t0 = clock();
 
-    Eigen::Vector2d e;
-    e(0) = (cs*cx - sn*cy + tx) - rlp->x;          // clpを推定位置で座標変換
-    e(1) = (sn*cx + cs*cy + ty) - rlp->y;
-    double err = e.transpose()*W*e;
+  const static int MAX_STEPS = 30;        // ICPの外側の繰り返しがないので多めにする
+  Pose2D pose = initPose;
+  double prevErr = 1000000;
+  for (int i=0; i<MAX_STEPS; ++i) {
+    Pose2D npose;
+    double curErr = calGaussNewtonDF(df, lps, pose, npose);
+
+    if (abs(prevErr - curErr) <= evthre) {   // 収束
+      if (curErr < prevErr) {
+        pose = npose;
+        prevErr = curErr;
+      }
+      break;
+    }
+    if (curErr < prevErr) {
+      pose = npose;
+      prevErr = curErr;
+    }
+    else
+      break;
+  }
+  estPose = pose;
 
+  chrono_time t1 = clock();
+  totalTime += duration(t0, t1);
+  ++timeCnt;
 
-    double drho = 1;
-    if (beRobust)
-      drho = robustWeightHuber(err);
-//      drho = robustWeightTukey(err);
+  return(prevErr);
+}
 
-    Eigen::Matrix<double, 2, 3> J;
-    J(0,0) = 1;
-    J(0,1) = 0;
-    J(0,2) = -sn*cx - cs*cy;
-    J(1,0) = 0;
-    J(1,1) = 1;
-    J(1,2) = cs*cx - sn*cy;
+// 推定位置poseで、距離場dfを使ってガウスニュートン法を1ステップ行い、newPoseを求める。
+// 誤差は点の位置での符号つき距離d、そのヤコビ行列は距離場の勾配(gx, gy)と回転の微分から作る。
+// 距離場の外にある点は使わない。重みつき誤差の平均を返す
+double PoseOptimizerGN::calGaussNewtonDF(const DistanceField2D &df, const vector<LPoint2D> &lps, const Pose2D &pose, Pose2D &newPose) {
+  double tx = pose.tx;
+  double ty = pose.ty;
+  double th = pose.th;
+  double a = DEG2RAD(th);
+  double cs = cos(a);
+  double sn = sin(a);
 
-    Eigen::Matrix<double, 3, 2> A = drho*J.transpose()*W;    
+  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_HUBER : CostKernel::ROBUST_NONE;
+
+  double H[6] = {0, 0, 0, 0, 0, 0};
+  double g[3] = {0, 0, 0};
+  double totalErr = 0;
+  int num = 0;
+  for (size_t i=0; i<lps.size(); i++) {
+    const LPoint2D &lp = lps[i];
+    double x = cs*lp.x - sn*lp.y + tx;
+    double y = sn*lp.x + cs*lp.y + ty;
+    double d, gx, gy;
+    if (!df.interpolate(x, y, d, gx, gy))
+      continue;
+    double g2 = gx*(-sn*lp.x - cs*lp.y) + gy*(cs*lp.x - sn*lp.y);    // 回転に関する微分
+    double err = d*d;
+    double w = CostKernel::robustWeight(err, rtype, evlimit);
+
+    H[0] += w*gx*gx;
+    H[1] += w*gx*gy;
+    H[2] += w*gx*g2;
+    H[3] += w*gy*gy;
+    H[4] += w*gy*g2;
+    H[5] += w*g2*g2;
+    g[0] += w*gx*d;
+    g[1] += w*gy*d;
+    g[2] += w*g2*d;
+    totalErr += w*err;
+    ++num;
+  }
 
-    JWJ += A*J;
-    JWe += A*e;
-    totalErr += drho*err;
+  if (num < 3) {                           // 点が足りなければ解けない
+    newPose = pose;
+    return(HUGE_VAL);
   }
-  
-  Eigen::Vector3d d = -JWJ.inverse()*JWe;
-  newPose.setVal(tx+d(0), ty+d(1), MyUtil::add(th, RAD2DEG(d(2))));
 
-//  printf("newPose=(%g %g %g), totalErr=%g\n", newPose.tx, newPose.ty, newPose.th, totalErr);
+  Eigen::Matrix3d JWJ;
+  JWJ << H[0], H[1], H[2],
+         H[1], H[3], H[4],
+         H[2], H[4], H[5];
+  Eigen::Vector3d JWe(g[0], g[1], g[2]);
 
-  return(totalErr);
+  Eigen::Vector3d dv = -JWJ.ldlt().solve(JWe);
+  newPose.setVal(tx+dv(0), ty+dv(1), MyUtil::add(th, RAD2DEG(dv(2))));
+
+  return(totalErr/num);
 }
@@ -0,0 +1,101 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file PoseOptimizerLM.cpp
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#include "PoseOptimizerLM.h"
+#include "MyUtil.h"
+
+using namespace std;
+
+////////
+
+// データ対応づけ固定のもと、初期値initPoseを与えてロボット位置の推定値estPoseを求める
+double PoseOptimizerLM::optimizePose(Pose2D &initPose, Pose2D &estPose) {
+  chrono_time t0 = clock();
+
+  const static int MAX_STEPS = 20;
+  Pose2D pose = initPose;
+  Eigen::Matrix3d JWJ;
+  Eigen::Vector3d JWe;
+  double curErr = calNormalEquation(pose, JWJ, JWe);
+
+  double lambda = lambdaInit;                             // 減衰係数。ヘッセ行列の対角に対する比なので無次元
+  double nu = 2;                                          // 減衰係数を上げるときの倍率
+  for (int i=0; i<MAX_STEPS; ++i) {
+    if (curErr <= 0)                                      // 対応点がないか、誤差がない
+      break;
+
+    // 減衰項をつけた正規方程式を解く。減衰項を対角に比例させるので（Marquardtの方法）、
+    // 並進と回転の尺度の違いや、点数の多さに左右されない
+    Eigen::Matrix3d A = JWJ;
+    for (int k=0; k<3; k++)
+      A(k,k) += lambda*max(JWJ(k,k), 1.0e-9);
+    Eigen::Vector3d d = -A.ldlt().solve(JWe);
+
+    if (sqrt(d(0)*d(0) + d(1)*d(1)) <= stepThreT && abs(d(2)) <= stepThreA)    // ステップが十分小さい
+      break;
+
+    Pose2D npose;
+    npose.setVal(pose.tx+d(0), pose.ty+d(1), MyUtil::add(pose.th, RAD2DEG(d(2))));
+    Eigen::Matrix3d nJWJ;
+    Eigen::Vector3d nJWe;
+    double newErr = calNormalEquation(npose, nJWJ, nJWe);
+
+    // 実際の誤差減少量と、2次近似で予測した減少量の比。減衰項D=A-JWJについて、予測減少量はd'JWJd + 2d'Dd
+    Eigen::Vector3d ld = (A.diagonal() - JWJ.diagonal()).cwiseProduct(d);
+    double predRed = d.dot(JWJ*d) + 2*d.dot(ld);
+    double rho = (predRed > 0) ? (curErr - newErr)/predRed : -1;
+
+    if (rho > 0) {                                        // 誤差が減ったのでステップを採用し、減衰を弱める
+      double dErr = curErr - newErr;
+      pose = npose;
+      curErr = newErr;
+      JWJ = nJWJ;
+      JWe = nJWe;
+      double r = 2*rho - 1;
+      lambda *= max(1.0/3, 1 - r*r*r);
+      nu = 2;
+      if (dErr <= evthre)                                 // 収束
+        break;
+    }
+    else {                                                // 誤差が増えたのでステップを捨て、減衰を強める
+      lambda *= nu;
+      nu *= 2;
+    }
+  }
+  estPose = pose;
+
+  chrono_time t1 = clock();
+  double dur = duration(t0, t1);
+  totalTime += dur;
+  ++timeCnt;
+
+  return(curErr);
+}
+
+//////
+
+// 推定位置poseでの正規方程式の係数JWJ, JWeを求め、誤差を返す
+double PoseOptimizerLM::calNormalEquation(const Pose2D &pose, Eigen::Matrix3d &JWJ, Eigen::Vector3d &JWe) {
+  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_HUBER : CostKernel::ROBUST_NONE;
+
+  double H[6], g[3];
+  double err = CostKernel::accumulateNormalEq(curPc, refPc, pose.tx, pose.ty, DEG2RAD(pose.th), rtype, evlimit, H, g);
+
+  JWJ << H[0], H[1], H[2],
+         H[1], H[3], H[4],
+         H[2], H[4], H[5];
+  JWe << g[0], g[1], g[2];
+
+  return(err);
+}
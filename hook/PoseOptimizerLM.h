@@ -0,0 +1,75 @@
+﻿/****************************************************************************
+ * LittleSLAM: 2D-Laser SLAM for educational use
+ * Copyright (C) 2017-2018 Masahiro Tomono
+ * Copyright (C) 2018 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * @file PoseOptimizerLM.h
+ * @author Masahiro Tomono
+ ****************************************************************************/
+
+#ifndef _POSE_OPTIMIZER_LM_H_
+#define _POSE_OPTIMIZER_LM_H_
+
+#include "PoseOptimizer.h"
+#include "PointCloud2D.h"
+#include "CostKernel.h"
+
+// レーベンバーグ・マーカート法でコスト関数を最小化する。
+// ガウスニュートン法のヘッセ行列の対角に減衰項を加え、ステップの当否に応じて減衰の強さを変える
+class PoseOptimizerLM : public PoseOptimizer
+{
+private:
+  double evlimit;
+  bool beRobust;
+
+  double lambdaInit;                           // 減衰係数の初期値。ヘッセ行列の各対角要素に対する比
+  double stepThreT;                            // ステップ幅の閾値（並進）[m]。これ以下なら繰り返し終了
+  double stepThreA;                            // ステップ幅の閾値（回転）[rad]。これ以下なら繰り返し終了
+
+  PointCloud2D curPc;                          // 対応がとれた現在スキャンの点群
+  PointCloud2D refPc;                          // 対応がとれた参照スキャンの点群
+
+public:
+  PoseOptimizerLM() : evlimit(0.05), beRobust(false), lambdaInit(0.001), stepThreT(0.00001), stepThreA(DEG2RAD(0.001)) {
+  }
+
+  ~PoseOptimizerLM() {
+  }
+
+  // DataAssociatorで対応のとれた点群cur, refを設定
+  virtual void setPoints(std::vector<const LPoint2D*> &cur, std::vector<const LPoint2D*> &ref) {
+    curPc.setPoints(cur);
+    refPc.setPoints(ref);
+  }
+
+  void setBeRobust(bool t) {
+    beRobust = t;
+  }
+
+  void setLambdaInit(double l) {
+    lambdaInit = l;
+  }
+
+  void setStepThre(double t, double a) {
+    stepThreT = t;
+    stepThreA = DEG2RAD(a);
+  }
+
+/////
+
+  virtual PoseOptimizer *clone() const {
+    return(new PoseOptimizerLM(*this));
+  }
+
+  virtual double optimizePose(Pose2D &initPose, Pose2D &estPose);
+
+private:
+  double calNormalEquation(const Pose2D &pose, Eigen::Matrix3d &JWJ, Eigen::Vector3d &JWe);
+};
+
+#endif
@@ -21,14 +21,14 @@ using namespace std;
 
 // データ対応づけ固定のもと、初期値initPoseを与えてロボット位置の推定値estPoseを求める
 double PoseOptimizerMAP::optimizePose(Pose2D &initPose, Pose2D &estPose) {
-//  printf("curLps.size=%zu, refLps.size=%zu\n", curLps.size(), refLps.size());
+//  printf("curPc.size=%zu, refPc.size=%zu\n", curPc.size(), refPc.size());
   const static int MAX_STEPS = 10;
   predPose = initPose;
   Pose2D pose = initPose;
   double prevErr = 1000000;
   for (int i=0; i<MAX_STEPS; ++i) {
     Pose2D npose;
-    double curErr = calGaussNewton(pose, curLps, refLps, npose);
+    double curErr = calGaussNewton(pose, npose);
 
     if (abs(prevErr - curErr) <= evthre) {   // 収束
       if (curErr < prevErr) {
@@ -54,63 +54,25 @@ double PoseOptimizerMAP::optimizePose(Pose2D &initPose, Pose2D &estPose) {
 
 //////
 
-// 推定位置pose、現在スキャン点群curLps、参照スキャン点群refLps
-double PoseOptimizerMAP::calGaussNewton(const Pose2D &pose, vector<const LPoint2D*> &curLps, vector<const LPoint2D*> &refLps, Pose2D &newPose) {
+// 推定位置poseでガウスニュートン法を1ステップ行い、newPoseを求める。
+// 正規方程式の係数は、CostKernelで対応点を1回走査してまとめて計算する
+double PoseOptimizerMAP::calGaussNewton(const Pose2D &pose, Pose2D &newPose) {
   double tx = pose.tx;
   double ty = pose.ty;
   double th = pose.th;
   double a = DEG2RAD(th);
-  double cs = cos(a);
-  double sn = sin(a);
-
-  Eigen::Matrix3d JWJ = Eigen::Matrix3d::Zero(3,3);  
-  Eigen::Vector3d JWe = Eigen::Vector3d::Zero(3);  
-  double totalErr=0;
-
-  for (size_t i=0; i<curLps.size(); i++) {
-    const LPoint2D *clp = curLps[i];                         // 現在スキャンの点
-    const LPoint2D *rlp = refLps[i];                         // 参照スキャンの点
-
-    if (rlp->type != LINE)                                   // 法線のない点は使わない
-      continue;
-
-    double cx = clp->x;
-    double cy = clp->y;
-
-// 外れ値テスト
-    if (hasOutliers)
-      addNoise(i, cx, cy);
-
-    Eigen::Matrix2d W;
-    W(0,0) = rlp->nx*rlp->nx;
-    W(1,0) = rlp->ny*rlp->nx;
-    W(0,1) = rlp->nx*rlp->ny;
-    W(1,1) = rlp->ny*rlp->ny;
-
-    Eigen::Vector2d e;
-    e(0) = (cs*cx - sn*cy + tx) - rlp->x;          // clpを推定位置で座標変換
-    e(1) = (sn*cx + cs*cy + ty) - rlp->y;
-    double err = e.transpose()*W*e;
-
-    double drho = 1;
-    if (beRobust)
-      drho = robustWeightHuber(err);
-//      drho = robustWeightTukey(err);
-
-    Eigen::Matrix<double, 2, 3> J;
-    J(0,0) = 1;
-    J(0,1) = 0;
-    J(0,2) = -sn*cx - cs*cy;
-    J(1,0) = 0;
-    J(1,1) = 1;
-    J(1,2) = cs*cx - sn*cy;
-
-    Eigen::Matrix<double, 3, 2> A = drho*J.transpose()*W;    
-
-    JWJ += A*J;
-    JWe += A*e;
-    totalErr += drho*err;
-  }
+
+  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_HUBER : CostKernel::ROBUST_NONE;
+//  CostKernel::RobustType rtype = beRobust ? CostKernel::ROBUST_TUKEY : CostKernel::ROBUST_NONE;
+
+  double H[6], g[3];
+  double totalErr = CostKernel::accumulateNormalEq(curPc, refPc, tx, ty, a, rtype, evlimit, H, g);
+
+  Eigen::Matrix3d JWJ;
+  JWJ << H[0], H[1], H[2],
+         H[1], H[3], H[4],
+         H[2], H[4], H[5];
+  Eigen::Vector3d JWe(g[0], g[1], g[2]);
 
   // オドメトリによる予測値
   Eigen::Matrix3d mcov;
@@ -16,6 +16,8 @@
 #define _POSE_OPTIMIZER_MAP_H_
 
 #include "PoseOptimizer.h"
+#include "PointCloud2D.h"
+#include "CostKernel.h"
 #include "PointCloudMap.h"
 #include "PoseFuser.h"
 
@@ -27,8 +29,8 @@ private:
   bool hasOutliers;
   bool beRobust;
 
-  std::vector<const LPoint2D*> curLps;         // 対応がとれた現在スキャンの点群
-  std::vector<const LPoint2D*> refLps;         // 対応がとれた参照スキャンの点群
+  PointCloud2D curPc;                          // 対応がとれた現在スキャンの点群
+  PointCloud2D refPc;                          // 対応がとれた参照スキャンの点群
 
   Pose2D predPose;
   Eigen::Matrix3d W;                           // オドメトリの共分散行列
@@ -45,8 +47,12 @@ public:
   // DataAssociatorで対応のとれた点群cur, refを設定
   virtual void setPoints(std::vector<const LPoint2D*> &cur, std::vector<const LPoint2D*> &ref) {
   //  cfunc->setPoints(curLps, refLps);    
-    curLps = cur;
-    refLps = ref;
+    curPc.setPoints(cur);
+    refPc.setPoints(ref);
+    if (hasOutliers) {                         // 外れ値テスト
+      for (size_t i=0; i<curPc.size(); i++)
+        addNoise(i, curPc.x[i], curPc.y[i]);
+    }
   }
 
   void setHasOutliers(bool t) {
@@ -57,30 +63,6 @@ public:
     beRobust = t;
   }
 
-  // Huber robust function
-  double robustWeightHuber(double e) {
-    double drho;
-    if (e < evlimit*evlimit)
-      drho = 1;
-    else 
-      drho = evlimit/sqrt(e);
-
-    return(drho)  ;
-  }
-
-  // Tukey robust function
-  double robustWeightTukey(double e) {
-    double drho;
-    if (e < evlimit*evlimit) {
-      double r = e/(evlimit*evlimit);
-      drho = (1-r)*(1-r);      
-    }
-    else 
-      drho = 0;
-
-    return(drho)  ;
-  }
-
   void addNoise(size_t i, double &cx, double &cy) {
     if (i%10 == 0) {
       cx += 0.3;
@@ -94,8 +76,12 @@ public:
 
 /////
 
+  virtual PoseOptimizer *clone() const {
+    return(new PoseOptimizerMAP(*this));
+  }
+
   virtual double optimizePose(Pose2D &initPose, Pose2D &estPose);
-  double calGaussNewton(const Pose2D &pose, std::vector<const LPoint2D*> &curLps, std::vector<const LPoint2D*> &refLps, Pose2D &newPose);
+  double calGaussNewton(const Pose2D &pose, Pose2D &newPose);
   void calOdometryCovariance(const Pose2D &predPose, Eigen::Matrix3d &mcov);
 };
 
@@ -29,6 +29,10 @@ public:
 
 /////
 
+  virtual PoseOptimizer *clone() const {
+    return(new PoseOptimizerSD(*this));
+  }
+
   virtual double optimizePose(Pose2D &initPose, Pose2D &estPose);
 };
 
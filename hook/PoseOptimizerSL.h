@@ -29,6 +29,10 @@ public:
 
 /////
 
+  virtual PoseOptimizer *clone() const {
+    return(new PoseOptimizerSL(*this));
+  }
+
   virtual double optimizePose(Pose2D &initPose, Pose2D &estPose);
   double search(double ev0, Pose2D &pose, Pose2D &dp);
   double objFunc(double tt, Pose2D &pose, Pose2D &dp);
@@ -36,8 +36,10 @@ const Scan2D *RefScanMakerBS::makeRefScan() {
     rp.y = R[1][0]*mp.x + R[1][1]*mp.y + ty;
     rp.nx = R[0][0]*mp.nx + R[0][1]*mp.ny;        // 法線ベクトル
     rp.ny = R[1][0]*mp.nx + R[1][1]*mp.ny;
+    rp.type = mp.type;                            // 点のタイプ
     refLps.emplace_back(rp);
   }
+  refScan.pose = lastPose;                        // 参照スキャンを計測した位置
 
   return(&refScan);
 }